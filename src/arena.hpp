@@ -0,0 +1,69 @@
+#ifndef __ARENA_HPP__
+#define __ARENA_HPP__
+
+#include "utility.hpp"
+
+#include <memory>
+
+//! \brief A bump allocator. Memory is handed out from large chunks and never freed individually, only all at once
+//! by reset(), after which it is reused. Not thread safe.
+class Arena {
+public:
+  //! \brief Constructor, takes the number of bytes to reserve up front.
+  Arena(size_t bytes=0) {
+    if (bytes>0) addChunk(bytes);
+  }
+
+  //! \brief Allocate (uninitialized) space for n objects of type T.
+  template<typename T> T* allocate(size_t n) {
+    const size_t align = alignof(T) > alignof(double) ? alignof(T) : alignof(double);
+    size_t bytes = n*sizeof(T);
+    // Offset in the current chunk, rounded up for alignment.
+    size_t start = (offset + align - 1)/align*align;
+    if (chunks.empty() || start + bytes > chunk_sizes.back()) {
+      addChunk(std::max(bytes + align, 2*capacity()));
+      start = 0;
+    }
+    offset = start + bytes;
+    used += bytes;
+    return reinterpret_cast<T*>(chunks.back().get() + start);
+  }
+
+  //! \brief Release everything. If the memory was spread over several chunks, it is replaced by a single chunk of the
+  //! total size, so the next batch of allocations is contiguous.
+  void reset() {
+    if (chunks.size()>1) {
+      size_t total = capacity();
+      chunks.clear();
+      chunk_sizes.clear();
+      addChunk(total);
+    }
+    offset = 0;
+    used = 0;
+  }
+
+  //! \brief The total number of bytes reserved.
+  size_t capacity() const {
+    size_t total = 0;
+    for (auto size : chunk_sizes) total += size;
+    return total;
+  }
+
+  //! \brief The number of bytes handed out since the last reset.
+  size_t getUsed() const { return used; }
+
+private:
+  void addChunk(size_t bytes) {
+    // new char[] is aligned for any fundamental type.
+    chunks.push_back(std::unique_ptr<char[]>(new char[bytes]));
+    chunk_sizes.push_back(bytes);
+    offset = 0;
+  }
+
+  vector<std::unique_ptr<char[]> > chunks;
+  vector<size_t> chunk_sizes;
+  size_t offset = 0;
+  size_t used = 0;
+};
+
+#endif // __ARENA_HPP__
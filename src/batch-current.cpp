@@ -0,0 +1,172 @@
+#include "batch-current.hpp"
+
+#include <memory>
+
+namespace {
+  //! \brief Advance a splitmix64 state and return a uniform number in [0, 1).
+  inline double uniform(unsigned long long& state) {
+    unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = z ^ (z >> 31);
+    return (z >> 11) * (1./9007199254740992.);
+  }
+
+  //! \brief The data of a set of lanes, as a structure of arrays. Counts are kept as doubles too, so that every array
+  //! in the update pass has the same element width.
+  struct Lanes {
+    Lanes(int L) : a(L), b(L), g(L), d(L), p(L), m(L), t(L, 0.), waiting(L), choice(L), demon_rate(L), nl(L, 0.), nr(L, 0.),
+                   J(L, 0.), remaining(L), finished(L, 0.) {};
+
+    //! \brief Rates of the lane's configuration.
+    vector<double> a, b, g, d, p, m;
+
+    //! \brief Time into the current trial.
+    vector<double> t;
+
+    //! \brief This event's random numbers, an exponential waiting time (before dividing by the total rate) and a
+    //! uniform choice, and its demon rate factor.
+    vector<double> waiting, choice, demon_rate;
+
+    //! \brief Occupations, integrated current, trials left to run, and whether the current trial just ended (0 or 1).
+    vector<double> nl, nr, J, remaining, finished;
+  };
+
+  //! \brief Advance every lane by one event, given the event's random numbers and demon rate factors. Lanes that are
+  //! done still compute, but change nothing. The loop has no calls, indirect loads or branches, so it vectorizes
+  //! (the comparisons need -fno-trapping-math to be if-converted, see the Makefile).
+  void advance(Lanes& lanes, double runtime) {
+    const int L = lanes.t.size();
+    const double *__restrict a = lanes.a.data(), *__restrict b = lanes.b.data(), *__restrict g = lanes.g.data();
+    const double *__restrict d = lanes.d.data(), *__restrict p = lanes.p.data(), *__restrict m = lanes.m.data();
+    const double *__restrict waiting = lanes.waiting.data(), *__restrict choice = lanes.choice.data();
+    const double *__restrict demon_rate = lanes.demon_rate.data(), *__restrict remaining = lanes.remaining.data();
+    double *__restrict t = lanes.t.data(), *__restrict nl = lanes.nl.data(), *__restrict nr = lanes.nr.data();
+    double *__restrict J = lanes.J.data(), *__restrict finished = lanes.finished.data();
+    for (int l=0; l<L; ++l) {
+      // We use 1e-5 as "effectively zero" for the demon rate factor.
+      double dm = demon_rate[l]<=0 ? 1e-5 : demon_rate[l];
+      // Cumulative rates, in the order of the transition types of CurrentSystem.
+      double c0 = a[l];
+      double c1 = c0 + d[l];
+      double c2 = c1 + nl[l]*g[l];
+      double c3 = c2 + nr[l]*b[l];
+      double c4 = c3 + nl[l]*p[l]*dm;
+      double R = c4 + nr[l]*m[l]*dm;
+      // Waiting time.
+      t[l] += waiting[l]/R;
+      // Only enact the transition if it happens before the end of the trial.
+      double running = remaining[l]>0 ? 1. : 0., before = t[l]<runtime ? 1. : 0.;
+      double live = running*before;
+      // Transition type: u_k is live if the choice is past c_k, so type k happened if u_(k-1) is and u_k is not.
+      double x = choice[l]*R;
+      double u0 = x>=c0 ? live : 0., u1 = x>=c1 ? live : 0., u2 = x>=c2 ? live : 0.;
+      double u3 = x>=c3 ? live : 0., u4 = x>=c4 ? live : 0.;
+      double s0 = live - u0, s1 = u0 - u1, s2 = u1 - u2, s3 = u2 - u3, s4 = u3 - u4, s5 = u4;
+      nl[l] += s0 - s2 - s4 + s5;
+      nr[l] += s1 - s3 + s4 - s5;
+      J[l] += s4 - s5;
+      finished[l] = running - live;
+    }
+  }
+}
+
+BatchCurrentSystem::BatchCurrentSystem(int t, int w) : nthreads(t), width(w) {
+  if (width<1) width = 1;
+  seed = static_cast<unsigned>(std::chrono::system_clock::now().time_since_epoch().count());
+}
+
+void BatchCurrentSystem::addConfiguration(const CurrentSystem& system) {
+  alpha.push_back(system.get_alpha());
+  beta.push_back(system.get_beta());
+  gamma.push_back(system.get_gamma());
+  delta.push_back(system.get_delta());
+  kp.push_back(system.get_kp());
+  km.push_back(system.get_km());
+  // Copy the demon function. The combined table is built when statistics are gathered.
+  configurations.push_back(system.getDemonFunction());
+}
+
+vector<map<int, int> > BatchCurrentSystem::gatherCurrentStatistics(int trials, double time) {
+  const int K = size();
+  // Combine the demon functions into one table, one link per configuration. The rule shares the configurations.
+  int capacity = 1;
+  for (auto &table : configurations) capacity = std::max(capacity, table.getCapacity());
+  auto tables = std::make_shared<const vector<DemonTable> >(configurations);
+  demon = DemonTable(K, capacity);
+  demon.setRule([tables](int k, int nl, int nr) { return (*tables)[k].evaluate(0, nl, nr); });
+  // Each block of trials is run (for all configurations) by one thread, into its own histograms.
+  int nblocks = numberOfBlocks(trials);
+  vector<vector<map<int, int> > > block_counts(nblocks, vector<map<int, int> >(K));
+  parallelFor(nblocks, nthreads, [&](int b) {
+    runBlock(b, trials, time, block_counts[b]);
+  });
+  // Combine the blocks.
+  vector<map<int, int> > counts(K);
+  for (auto &block : block_counts)
+    for (int k=0; k<K; ++k)
+      for (auto cn : block[k]) counts[k][cn.first] += cn.second;
+  return counts;
+}
+
+void BatchCurrentSystem::runBlock(int block, int trials, double runtime, vector<map<int, int> >& counts) const {
+  const int K = size(), L = K*width;
+  int first = block*shard_block_size, ntrials = std::min(trials, first + shard_block_size) - first;
+
+  Lanes lanes(L);
+  vector<int> base(L);
+  vector<unsigned long long> rng(L);
+  // The demon functions. A block that reaches occupations beyond the shared table grows its own copy.
+  const DemonTable *table = &demon;
+  DemonTable grown;
+  int D = table->getCapacity();
+  const double *demon_table = table->data();
+  int active = 0;
+  for (int l=0; l<L; ++l) {
+    int k = l/width, w = l%width;
+    lanes.a[l] = alpha[k];
+    lanes.b[l] = beta[k];
+    lanes.g[l] = gamma[k];
+    lanes.d[l] = delta[k];
+    lanes.p[l] = kp[k];
+    lanes.m[l] = km[k];
+    base[l] = k*D*D;
+    // Split the block's trials between the configuration's lanes.
+    lanes.remaining[l] = ntrials/width + (w < ntrials%width ? 1 : 0);
+    if (lanes.remaining[l]>0) ++active;
+    rng[l] = substreamSeed(substreamSeed(seed, k), block*width + w);
+  }
+  vector<double> &nl = lanes.nl, &nr = lanes.nr, &J = lanes.J, &remaining = lanes.remaining;
+
+  while (active>0) {
+    // Draw this event's random numbers and look up the demon rate factors. Calls and indirect loads are kept out of
+    // the update pass, so that it can be vectorized.
+    for (int l=0; l<L; ++l) {
+      lanes.waiting[l] = -log(1. - uniform(rng[l]));
+      lanes.choice[l] = uniform(rng[l]);
+      lanes.demon_rate[l] = demon_table[base[l] + static_cast<int>(nl[l])*D + static_cast<int>(nr[l])];
+    }
+    advance(lanes, runtime);
+    // Materialize the demon functions for new occupations.
+    double max_occupation = 0;
+    for (int l=0; l<L; ++l) max_occupation = std::max(max_occupation, std::max(nl[l], nr[l]));
+    if (max_occupation>=D) {
+      if (table==&demon) {
+        grown = demon;
+        table = &grown;
+      }
+      grown.reserve(static_cast<int>(max_occupation));
+      D = table->getCapacity();
+      demon_table = table->data();
+      for (int l=0; l<L; ++l) base[l] = (l/width)*D*D;
+    }
+    // Record the lanes whose trials ended, and start their next trials.
+    for (int l=0; l<L; ++l) {
+      if (lanes.finished[l]==0) continue;
+      ++counts[l/width][static_cast<int>(J[l])];
+      nl[l] = nr[l] = J[l] = 0;
+      lanes.t[l] = 0.;
+      if (--remaining[l]==0) --active;
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#ifndef __BATCH_CURRENT_HPP__
+#define __BATCH_CURRENT_HPP__
+
+#include "current.hpp"
+
+//! \brief Simulates many CurrentSystem configurations (parameters and demon function) in one pass.
+//!
+//! Each configuration gets a number of lanes, and all lanes advance one event at a time in lockstep, so the inner
+//! loop runs over contiguous (structure of arrays) lane data with no data dependent branches, and can be vectorized.
+//! Events are chosen with the direct method (one draw for the waiting time, one for the channel), which has the same
+//! statistics as the competing exponentials of CurrentSystem::runCurrent. Blocks of trials are spread over threads.
+class BatchCurrentSystem {
+public:
+  //! \brief Constructor, takes the number of threads to use (0 means one per core) and the number of lanes per configuration.
+  BatchCurrentSystem(int=0, int=8);
+
+  //! \brief Add a configuration, copying the parameters and demon function of a system.
+  void addConfiguration(const CurrentSystem&);
+
+  //! \brief The number of configurations.
+  int size() const { return alpha.size(); }
+
+  //! \brief Set the seed that the random substreams of the lanes are derived from.
+  void setSeed(unsigned s) { seed = s; }
+
+  //! \brief Run trials of every configuration, return a map of (integrated current value, number of occurences) for
+  //! each configuration.
+  vector<map<int, int> > gatherCurrentStatistics(int, double);
+
+private:
+  //! \brief Run one block of trials of every configuration, adding to the histograms.
+  void runBlock(int, int, double, vector<map<int, int> >&) const;
+
+  int nthreads;
+
+  //! \brief Lanes per configuration.
+  int width;
+
+  unsigned seed;
+
+  //! \brief Parameters, one entry per configuration.
+  vector<double> alpha, beta, gamma, delta, kp, km;
+
+  //! \brief The demon functions of the configurations.
+  vector<DemonTable> configurations;
+
+  //! \brief All demon functions in one table, one link per configuration, built when statistics are gathered. Blocks
+  //! of trials share it, and only copy it if they need to grow it.
+  DemonTable demon;
+};
+
+#endif // __BATCH_CURRENT_HPP__
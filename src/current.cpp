@@ -1,19 +1,13 @@
 #include "current.hpp"
 
 CurrentSystem::CurrentSystem() {
-  unsigned seed = static_cast<unsigned>(std::chrono::system_clock::now().time_since_epoch().count());
-  generator = std::default_random_engine(seed);
+  seed = static_cast<unsigned>(std::chrono::system_clock::now().time_since_epoch().count());
+  generator = RandomEngine(seed);
   distribution = std::exponential_distribution<float>(1.0);
 
   double *occ = new double[occ_size*occ_size];
   occupation = new double*[occ_size];
   for (int i=0; i<occ_size; ++i) occupation[i] = &occ[i*occ_size];
-  // Allocate demon function
-  double *dem = new double[demon_size*demon_size];
-  demon_function = new double*[demon_size];
-  for (int i=0; i<demon_size; ++i) demon_function[i] = &dem[i*demon_size];
-  // Initialize to 1.
-  for (int i=0; i<demon_size*demon_size; ++i) dem[i] = 1.;
 }
 
 CurrentSystem::~CurrentSystem() {
@@ -22,125 +16,89 @@ CurrentSystem::~CurrentSystem() {
     delete [] occ;
     delete [] occupation;
   }
-  if (demon_function) {
-    double *dem = demon_function[0];
-    delete [] demon_function;
-  }
 }
 
 int CurrentSystem::getCurrent(double runtime) {
-  int nl = 0, nr = 0, J = 0;
-  double time = 0;
-  auto expnum = std::bind(distribution, generator);
-  
-  // Run until time is done.
-  while (time<runtime) {
-    int type = 0;
-
-    // Get the demon rate factor.
-    double demon_rate = (nl<demon_size && nr<demon_size) ? demon_function[nl][nr] : 1.;
-
-    // Inverse rate. We use 100000 as "effectively infinite."
-    double demon_scale = (demon_rate<=0) ? 100000 : 1./demon_rate;
-
-    // System -> left site, System -> right site
-    double dt = expnum()/alpha, ndt = distribution(generator)/delta;
-    if (ndt<dt) {
-      type = 1;
-      dt = ndt;
-    }
-    if (nl>0) {
-      // Left site -> system.
-      ndt = distribution(generator)/(nl*gamma);
-      if (ndt<dt) {
-        type = 2;
-        dt = ndt;
-      }
-      // Left site -> right site
-      ndt = distribution(generator)/(nl*kp) * demon_scale;
-      if (ndt<dt) {
-        type = 4;
-        dt = ndt;
-      }
-    }
-    if (nr>0) {
-      // Right site -> system (destruction).
-      ndt = distribution(generator)/(nr*beta);
-      if (ndt<dt) {
-        type = 3;
-        dt = ndt;
-      }
-      // Right site -> left site.
-      ndt = distribution(generator)/(nr*km) * demon_scale;
-      if (ndt<dt) {
-        type = 5;
-        dt = ndt;
-      }
-    }
-
-    // Increment occupation.
-    //dt = dt<time - runtime ? dt : time - runtime; 
-    if (record_occupation && nl<occ_size && nr<occ_size) occupation[nl][nr] += dt;
+  // Only pay for occupation bookkeeping if it is being recorded.
+  if (record_occupation) {
+    OccupationObserver observer(occupation, occ_size);
+    return runCurrent(runtime, observer);
+  }
+  NullObserver observer;
+  return runCurrent(runtime, observer);
+}
 
-    // Increment time.
-    time += dt;
+map<int, int> CurrentSystem::gatherCurrentStatistics(int trials, double time) {
+  // Run all the trials as a single shard.
+  ShardData data = gatherShardStatistics(trials, time, Shard());
+  // Add to the occupation.
+  if (record_occupation) {
+    vector<double> occ = data.totalOccupation();
+    for (int i=0; i<occ_size; ++i)
+      for (int j=0; j<occ_size; ++j)
+        occupation[i][j] += occ[i*occ_size+j];
+  }
+  // Return the map
+  return data.counts;
+}
 
-    // If the next event happens after the simulation is done, just return.
-    if (runtime <= time);
+ShardData CurrentSystem::gatherShardStatistics(int trials, double time, const Shard& shard) {
+  ShardData data;
+  data.time = time;
+  data.seed = seed;
+  data.trials = trials;
+  if (record_occupation) data.occ_size = occ_size;
+  // Each call gets its own substreams, so gathering twice does not repeat the same trials.
+  unsigned call_seed = substreamSeed(seed, gathers++);
+  // Occupation buffer for a single block.
+  vector<double> occ(occ_size*occ_size);
+  vector<double*> rows(occ_size);
+  for (int i=0; i<occ_size; ++i) rows[i] = &occ[i*occ_size];
+
+  int nblocks = numberOfBlocks(trials);
+  for (int b=shard.firstBlock(nblocks); b<shard.lastBlock(nblocks); ++b) {
+    // Start the block's substream.
+    generator.seed(substreamSeed(call_seed, b));
+    int first = b*shard_block_size, last = std::min(trials, first + shard_block_size);
+    if (record_occupation) {
+      std::fill(occ.begin(), occ.end(), 0.);
+      OccupationObserver observer(rows.data(), occ_size);
+      gatherBlock(first, last, time, observer, data.counts);
+      data.occupation[b] = occ;
+    }
     else {
-      // Enact transition.
-      switch (type) {
-        case 0: {
-          ++nl;
-          break;
-        }
-        case 1: {
-          ++nr;
-          break;
-        }
-        case 2: {
-          --nl;
-          break;
-        }
-        case 3: {
-          --nr;
-          break;
-        }
-        case 4: {
-          --nl;
-          ++nr;
-          ++J;
-          break;
-        }
-        case 5: {
-          ++nl;
-          --nr;
-          --J;
-          break;
-        } 
-      }
+      NullObserver observer;
+      gatherBlock(first, last, time, observer, data.counts);
     }
+    // There is no demon entropy for this system.
+    data.entropy[b] = 0.;
   }
 
-  // Return the current.
-  return J;
+  return data;
 }
 
-map<int, int> CurrentSystem::gatherCurrentStatistics(int trials, double time) {
-  // Count currents.
-  map<int, int> counts;
-
-  for (int i=0; i<trials; ++i) {
+template<typename Observer> void CurrentSystem::gatherBlock(int first, int last, double time, Observer& observer, map<int, int>& counts) {
+  // With telemetry, also count the kernel's work and time each trial.
+  TelemetryObserver monitor;
+  auto monitored = observe(observer, monitor);
+  for (int i=first; i<last; ++i) {
     // Run for the time and see what (integrated) current we get.
-    int J = getCurrent(time);
+    int J;
+    if (telemetry) {
+      auto start = high_resolution_clock::now();
+      J = runCurrent(time, monitored);
+      monitor.addTrial(duration_cast<duration<double> >(high_resolution_clock::now()-start).count());
+    }
+    else J = runCurrent(time, observer);
     // Record the current.
     auto it = counts.find(J);
     if (it==counts.end()) counts.insert(pair<int, int>(J, 1));
     else ++it->second;
   }
-
-  // Return the map
-  return counts;
+  if (telemetry) {
+    telemetry->add(monitor);
+    telemetry->report();
+  }
 }
 
 void CurrentSystem::setAllParams(double a, double b, double g, double d, double k, double K) {
@@ -166,28 +124,28 @@ void CurrentSystem::setDemon_GreaterThan(double slow_rate) {
   // Rate cannot be zero.
   if (slow_rate==0) return;
   // Set rates.
-  for (int nl=0; nl<demon_size; ++nl)
-    for (int nr=nl+1; nr<demon_size; ++nr)
-      demon_function[nl][nr] = slow_rate; 
+  demon_function.setRule(DemonTable::uphill, [=](int, int, int) { return slow_rate; });
 }
 
 void CurrentSystem::setDemon_Random(double min) {
   // Rate cannot be zero.
   if (min==0) return;
   // Set rates.
-  for (int nl=0; nl<demon_size; ++nl)
-    for (int nr=nl+1; nr<demon_size; ++nr)
-      demon_function[nl][nr] = drand48()*(1-min) + min;
+  unsigned key = static_cast<unsigned>(drand48()*4294967296.);
+  demon_function.setRule(DemonTable::uphill, DemonTable::randomRule(key, min, 1.));
 }
 
 void CurrentSystem::setSystem_Random(double min, double max) {
   if (min==0) return;
   // Set rates.
-  for (int nl=0; nl<demon_size; ++nl)
-    for (int nr=0; nr<demon_size; ++nr)
-      demon_function[nl][nr] = drand48()*(max-min) + min;
+  unsigned key = static_cast<unsigned>(drand48()*4294967296.);
+  demon_function.setRule(DemonTable::randomRule(key, min, max));
 }
 
 void CurrentSystem::setDemonFunctionEntry(int l, int r, double d) {
-  if (l<demon_size && r<demon_size) demon_function[l][r] = d;
+  demon_function.setEntry(0, l, r, d);
+}
+
+void CurrentSystem::setDemonRule(std::function<double(int, int)> rule) {
+  demon_function.setRule([=](int, int nl, int nr) { return rule(nl, nr); });
 }
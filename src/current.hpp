@@ -2,6 +2,9 @@
 #define __CURRENT_HPP__
 
 #include "utility.hpp"
+#include "telemetry.hpp"
+#include "shard.hpp"
+#include "demon-table.hpp"
 
 class CurrentSystem {
 public:
@@ -11,9 +14,23 @@ public:
   //! \brief Run the simulation for a fixed amount of time, return the current.
   int getCurrent(double);
 
+  //! \brief Run the simulation for a fixed amount of time, return the current. The observer is notified of every
+  //! dwell and transition, see observers.hpp.
+  template<typename Observer> int runCurrent(double, Observer&);
+
   //! \brief Run many trials of the same system, return a map of (integrated current value, number of occurences).
   map<int, int> gatherCurrentStatistics(int, double);
 
+  //! \brief Run this shard's blocks of a set of trials. Each block runs on its own random substream, derived from the
+  //! seed, so the shards of a job can be run anywhere and merged. Occupation is gathered per block if it is being recorded.
+  ShardData gatherShardStatistics(int, double, const Shard&);
+
+  //! \brief Set the seed that the random substreams of the trials are derived from.
+  void setSeed(unsigned s) { seed = s; gathers = 0; }
+
+  //! \brief Report the work done gathering statistics to a telemetry object, or nothing if null.
+  void setTelemetry(Telemetry *t) { telemetry = t; }
+
   void set_alpha(double a)  { alpha = a; }
   void set_beta(double b)   { beta = b; }
   void set_gamma(double g)  { gamma = g; }
@@ -22,10 +39,17 @@ public:
   void set_km(double k)     { km = k; }
   void setAllParams(double, double, double, double, double, double);
 
+  double get_alpha() const  { return alpha; }
+  double get_beta() const   { return beta; }
+  double get_gamma() const  { return gamma; }
+  double get_delta() const  { return delta; }
+  double get_kp() const     { return kp; }
+  double get_km() const     { return km; }
+
   int getOccSize() const            { return occ_size; }
-  int getDemonSize() const          { return demon_size; }
+  int getDemonSize() const          { return demon_function.getCapacity(); }
   double** getOccupation() const    { return occupation; }
-  double** getDemonFunction() const { return demon_function; }
+  const DemonTable& getDemonFunction() const { return demon_function; }
 
   //! \brief Clear the occupation array.
   void clearOccupation();
@@ -43,6 +67,9 @@ public:
 
   //! \brief Set a single entry of the demon function.
   void setDemonFunctionEntry(int, int, double);
+
+  //! \brief Define the demon function by a rule of (nl, nr), which is materialized as occupations are reached.
+  void setDemonRule(std::function<double(int, int)>);
   
 private:
   double alpha = 1., beta = 1., gamma = 1., delta = 1.;
@@ -53,14 +80,133 @@ private:
   double **occupation = nullptr;
   bool record_occupation = false;
 
-  //! \brief The highest entry subject to a demon function.
-  int demon_size = 10;
-  //! \brief The demon function is the INVERSE RATES.
-  double **demon_function = nullptr;
+  //! \brief The demon function is the INVERSE RATES. It covers all occupations, and grows as they are reached.
+  DemonTable demon_function = DemonTable(1, 10);
+
+  //! \brief Run the trials [first, last), adding them to the histogram.
+  template<typename Observer> void gatherBlock(int, int, double, Observer&, map<int, int>&);
+
+  //! \brief The seed the random substreams are derived from, and the number of times statistics have been gathered.
+  unsigned seed;
+  unsigned gathers = 0;
 
-  std::default_random_engine generator;
+  //! \brief Telemetry to report to, if any.
+  Telemetry *telemetry = nullptr;
+
+  RandomEngine generator;
   std::exponential_distribution<float> distribution;
   
 };
 
+template<typename Observer> int CurrentSystem::runCurrent(double runtime, Observer& observer) {
+  int nl = 0, nr = 0, J = 0;
+  double time = 0;
+  // The demon table covers every occupation below its capacity, so it only has to be checked when an occupation
+  // increases, not when a rate is looked up.
+  int demon_capacity = demon_function.getCapacity();
+  const double *demon_table = demon_function.data();
+  auto reserve = [&](int n) {
+    if (n<demon_capacity) return;
+    demon_function.reserve(n);
+    demon_capacity = demon_function.getCapacity();
+    demon_table = demon_function.data();
+  };
+
+  // Run until time is done.
+  while (time<runtime) {
+    int type = 0;
+
+    // Get the demon rate factor.
+    double demon_rate = demon_table[nl*demon_capacity + nr];
+
+    // Inverse rate. We use 100000 as "effectively infinite."
+    double demon_scale = (demon_rate<=0) ? 100000 : 1./demon_rate;
+
+    // System -> left site, System -> right site
+    double dt = distribution(generator)/alpha, ndt = distribution(generator)/delta;
+    if (ndt<dt) {
+      type = 1;
+      dt = ndt;
+    }
+    if (nl>0) {
+      // Left site -> system.
+      ndt = distribution(generator)/(nl*gamma);
+      if (ndt<dt) {
+        type = 2;
+        dt = ndt;
+      }
+      // Left site -> right site
+      ndt = distribution(generator)/(nl*kp) * demon_scale;
+      if (ndt<dt) {
+        type = 4;
+        dt = ndt;
+      }
+    }
+    if (nr>0) {
+      // Right site -> system (destruction).
+      ndt = distribution(generator)/(nr*beta);
+      if (ndt<dt) {
+        type = 3;
+        dt = ndt;
+      }
+      // Right site -> left site.
+      ndt = distribution(generator)/(nr*km) * demon_scale;
+      if (ndt<dt) {
+        type = 5;
+        dt = ndt;
+      }
+    }
+
+    // Record the time spent in this state.
+    observer.dwell(nl, nr, dt);
+
+    // Increment time.
+    time += dt;
+
+    // If the next event happens after the simulation is done, just return.
+    if (runtime <= time);
+    else {
+      // Enact transition.
+      switch (type) {
+        case 0: {
+          ++nl;
+          reserve(nl);
+          break;
+        }
+        case 1: {
+          ++nr;
+          reserve(nr);
+          break;
+        }
+        case 2: {
+          --nl;
+          break;
+        }
+        case 3: {
+          --nr;
+          break;
+        }
+        case 4: {
+          --nl;
+          ++nr;
+          ++J;
+          reserve(nr);
+          break;
+        }
+        case 5: {
+          ++nl;
+          --nr;
+          --J;
+          reserve(nl);
+          break;
+        } 
+      }
+      observer.transition(type);
+    }
+  }
+
+  // Return the current.
+  return J;
+}
+
 #endif // __CURRENT_HPP__
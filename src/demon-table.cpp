@@ -0,0 +1,120 @@
+#include "demon-table.hpp"
+
+#include <stdexcept>
+
+DemonTable::DemonTable(int links, int cap) : nlinks(links), capacity(cap) {
+  if (capacity<1) capacity = 1;
+  rule = [](int, int, int) { return 1.; };
+  owned = vector<double>(nlinks*capacity*capacity, 1.);
+  table = owned.data();
+}
+
+DemonTable::DemonTable(int links, int cap, double *memory) : nlinks(links), capacity(cap), table(memory) {
+  rule = [](int, int, int) { return 1.; };
+  std::fill(table, table + nlinks*capacity*capacity, 1.);
+}
+
+DemonTable::DemonTable(const DemonTable& other) : nlinks(other.nlinks), capacity(other.capacity), rule(other.rule), layers(other.layers) {
+  owned = vector<double>(other.table, other.table + nlinks*capacity*capacity);
+  table = owned.data();
+}
+
+DemonTable& DemonTable::operator=(const DemonTable& other) {
+  if (this==&other) return *this;
+  nlinks = other.nlinks;
+  capacity = other.capacity;
+  rule = other.rule;
+  layers = other.layers;
+  owned = vector<double>(other.table, other.table + nlinks*capacity*capacity);
+  table = owned.data();
+  return *this;
+}
+
+double DemonTable::evaluate(int link, int nl, int nr) const {
+  if (nl<capacity && nr<capacity) return (*this)(link, nl, nr);
+  return define(link, nl, nr);
+}
+
+void DemonTable::setRule(Rule r) {
+  rule = r;
+  layers.clear();
+  for (int link=0; link<nlinks; ++link)
+    for (int nl=0; nl<capacity; ++nl)
+      for (int nr=0; nr<capacity; ++nr)
+        table[(link*capacity + nl)*capacity + nr] = rule(link, nl, nr);
+}
+
+void DemonTable::setRule(Predicate where, Rule r) {
+  // Entries that are materialized later use r where selected, and the old definition elsewhere. An older layer with
+  // the same plain function predicate is entirely covered by the new one, so it is dropped, keeping repeated calls
+  // from growing the definition.
+  typedef bool (*Function)(int, int, int);
+  if (const Function *f = where.target<Function>())
+    layers.erase(std::remove_if(layers.begin(), layers.end(), [&](const pair<Predicate, Rule>& layer) {
+      const Function *g = layer.first.target<Function>();
+      return g && *g==*f;
+    }), layers.end());
+  layers.push_back(std::make_pair(where, r));
+  for (int link=0; link<nlinks; ++link)
+    for (int nl=0; nl<capacity; ++nl)
+      for (int nr=0; nr<capacity; ++nr)
+        if (where(link, nl, nr)) table[(link*capacity + nl)*capacity + nr] = r(link, nl, nr);
+}
+
+void DemonTable::setEntry(int link, int nl, int nr, double d) {
+  reserve(std::max(nl, nr));
+  table[(link*capacity + nl)*capacity + nr] = d;
+}
+
+bool DemonTable::uphill(int, int nl, int nr) {
+  return nr>nl;
+}
+
+DemonTable::Rule DemonTable::randomRule(unsigned key, double min, double max) {
+  return [=](int link, int nl, int nr) {
+    unsigned long entry = (static_cast<unsigned long>(nl) << 32) | static_cast<unsigned>(nr);
+    unsigned r = substreamSeed(substreamSeed(key, link), entry);
+    return r/4294967296.*(max-min) + min;
+  };
+}
+
+bool DemonTable::writeToFile(const string fileName, int link) const {
+  // (Try to) open the file
+  std::ofstream fout(fileName);
+  // Check for success.
+  if (fout.fail()) {
+    cout << "File [" << fileName << "] failed to open.\n";
+    return false;
+  }
+  else {
+    // Print out data.
+    for (int i=0; i<capacity; ++i)
+      for (int j=0; j<capacity; ++j)
+        fout << i << "," << j << "," << (*this)(link, i, j) << endl;
+    // Close file.
+    fout.close();
+    // Return success.
+    return true;
+  }
+}
+
+void DemonTable::grow(int n) {
+  // A table in external memory has nowhere to grow, and indexing past it would corrupt its neighbours.
+  if (table!=owned.data())
+    throw std::length_error("Demon table in external memory cannot grow past " + toString(capacity) + ".");
+  int new_capacity = std::max(2*capacity, n+1);
+  vector<double> new_table(nlinks*new_capacity*new_capacity);
+  for (int link=0; link<nlinks; ++link)
+    for (int nl=0; nl<new_capacity; ++nl)
+      for (int nr=0; nr<new_capacity; ++nr)
+        new_table[(link*new_capacity + nl)*new_capacity + nr] = (nl<capacity && nr<capacity) ? (*this)(link, nl, nr) : define(link, nl, nr);
+  owned.swap(new_table);
+  table = owned.data();
+  capacity = new_capacity;
+}
+
+double DemonTable::define(int link, int nl, int nr) const {
+  for (auto layer=layers.rbegin(); layer!=layers.rend(); ++layer)
+    if (layer->first(link, nl, nr)) return layer->second(link, nl, nr);
+  return rule(link, nl, nr);
+}
@@ -0,0 +1,90 @@
+#ifndef __DEMON_TABLE_HPP__
+#define __DEMON_TABLE_HPP__
+
+#include "utility.hpp"
+
+//! \brief The demon functions (rate factors as a function of the occupations (nl, nr) of the two ends of a link) of a
+//! number of links, defined by a rule and materialized into a flat table.
+//!
+//! The table holds every occupation below its capacity, and grows (materializing the new entries from the rule) when
+//! a larger occupation is reserved. Kernels reserve when an occupation increases, so looking up a rate never needs a
+//! bounds check. Entries that were set explicitly keep their values when the table grows.
+class DemonTable {
+public:
+  //! \brief A rule gives the rate factor for (link, nl, nr).
+  typedef std::function<double(int, int, int)> Rule;
+
+  //! \brief A predicate selects entries by (link, nl, nr).
+  typedef std::function<bool(int, int, int)> Predicate;
+
+  //! \brief Constructor, takes the number of links and the initial capacity. The rule starts out as 1 everywhere.
+  DemonTable(int=1, int=8);
+
+  //! \brief Constructor for a table in external memory, which has room for nlinks x capacity^2 entries. Such tables
+  //! cannot grow, so the capacity must cover every occupation that can be reached. Reserving more throws a
+  //! std::length_error.
+  DemonTable(int, int, double*);
+
+  // Copies always own their memory.
+  DemonTable(const DemonTable&);
+  DemonTable& operator=(const DemonTable&);
+  DemonTable(DemonTable&&) = default;
+  DemonTable& operator=(DemonTable&&) = default;
+
+  //! \brief Entry (link, nl, nr). Both occupations must be below the capacity.
+  inline double operator()(int link, int nl, int nr) const {
+    return table[(link*capacity + nl)*capacity + nr];
+  }
+
+  //! \brief Entry (link, nl, nr), evaluating the rule if it has not been materialized.
+  double evaluate(int, int, int) const;
+
+  //! \brief Make sure occupations up to n are materialized.
+  inline void reserve(int n) {
+    if (n>=capacity) grow(n);
+  }
+
+  //! \brief Replace the rule, and set every materialized entry from it.
+  void setRule(Rule);
+
+  //! \brief Use the rule for the entries the predicate selects, and keep the current definition elsewhere. A predicate
+  //! that is a plain function replaces the layer set with the same function, rather than stacking on top of it.
+  void setRule(Predicate, Rule);
+
+  //! \brief Selects the entries where the particle hops onto the fuller site, nr>nl.
+  static bool uphill(int, int, int);
+
+  //! \brief Set a single entry, growing the table if needed.
+  void setEntry(int, int, int, double);
+
+  //! \brief A rule that gives a uniform random number in [min, max) for each entry, fixed by a key.
+  static Rule randomRule(unsigned, double, double);
+
+  int getLinks() const { return nlinks; }
+  int getCapacity() const { return capacity; }
+
+  //! \brief Pointer to the table, for kernels that index it themselves. Invalidated by growth.
+  const double* data() const { return table; }
+
+  //! \brief Write the materialized entries (nl, nr, value) of a link to a file.
+  bool writeToFile(const string, int=0) const;
+
+private:
+  //! \brief Grow the capacity to more than n.
+  void grow(int);
+
+  int nlinks, capacity;
+
+  //! \brief The table, either owned or in external memory.
+  double *table = nullptr;
+  vector<double> owned;
+
+  //! \brief Evaluate the definition of an entry.
+  double define(int, int, int) const;
+
+  //! \brief The definition of the entries: the layers set with a predicate, newest last, over a base rule.
+  Rule rule;
+  vector<pair<Predicate, Rule> > layers;
+};
+
+#endif // __DEMON_TABLE_HPP__
@@ -1,5 +1,9 @@
 #include "current.hpp"
 #include "large-current.hpp"
+#include "ensemble.hpp"
+#include "batch-current.hpp"
+#include "exact-current.hpp"
+#include "parallel-ring.hpp"
 // For mkdir
 #include <sys/stat.h>
 
@@ -22,6 +26,9 @@ int main(int argc, char **argv) {
   int slices = 21;
   double time = 1000.;
   int numsys = 20;
+  // Grid of tilts and bootstrap replicates for the large deviation estimator.
+  double smin = -1., smax = 1.;
+  int ns = 41, nboot = 20;
   string save = "data.csv";
   string directory = "demon";
 
@@ -36,8 +43,58 @@ int main(int argc, char **argv) {
   parser.get("slices", slices);
   parser.get("time", time);
   parser.get("numsys", numsys);
+  parser.get("smin", smin);
+  parser.get("smax", smax);
+  parser.get("ns", ns);
+  parser.get("nboot", nboot);
   parser.get("save", save);
   parser.get("directory", directory);
+  // Which part of the job to run, given as k/N.
+  Shard shard;
+  string shard_string;
+  parser.get("shard", shard_string);
+  if (!shard_string.empty() && !shard.parse(shard_string)) {
+    cout << "Could not parse shard [" << shard_string << "], expected k/N.\n";
+    return 1;
+  }
+
+  // Build and run the random systems as arena backed ensembles, in parallel, some number of systems at a time.
+  bool ensemble = false;
+  int threads = 0, batch = 0;
+  parser.get("ensemble", ensemble);
+  parser.get("threads", threads);
+  parser.get("batch", batch);
+
+  // Compute the exact current distribution of the small system. The occupation of each site is truncated as little as
+  // keeps the truncation error within exact_tol, but at no more than nmax.
+  bool exact = false;
+  double exact_tol = 1e-6;
+  int nmax = 64, fft_size = 1024;
+  parser.get("exact", exact);
+  parser.get("exact_tol", exact_tol);
+  parser.get("nmax", nmax);
+  parser.get("fft", fft_size);
+
+  // Run a long homogeneous ring split into segments simulated in parallel, or check the parallel ring engine against
+  // the sequential one on a small random ring.
+  bool ring = false, ring_check = false;
+  int sites = 1000, particles = 1000, segments = 0;
+  double window = 0.05, ring_demon = 0.1;
+  parser.get("ring", ring);
+  parser.get("ring_check", ring_check);
+  parser.get("sites", sites);
+  parser.get("particles", particles);
+  parser.get("segments", segments);
+  parser.get("window", window);
+  parser.get("ring_demon", ring_demon);
+  if (segments<1) segments = std::max(1u, std::thread::hardware_concurrency());
+
+  // Optional telemetry: counters from the gather loops and I/O times, written every so many seconds.
+  string telemetry_file;
+  double telemetry_interval = 10.;
+  parser.get("telemetry", telemetry_file);
+  parser.get("telemetry_interval", telemetry_interval);
+  Telemetry *telemetry = telemetry_file.empty() ? nullptr : new Telemetry(telemetry_file, telemetry_interval);
 
   // Print message to screen.
   // cout << "Seed: " << seed << "\n";
@@ -46,6 +103,8 @@ int main(int argc, char **argv) {
   // A current system.
   CurrentSystem system;
   system.setAllParams(alpha, beta, gamma, delta, kp, km);
+  system.setSeed(seed);
+  system.setTelemetry(telemetry);
 
   // Start timing.
   auto start_time = high_resolution_clock::now();
@@ -59,22 +118,96 @@ int main(int argc, char **argv) {
     // Parameters for advancing demon.
     double initialRate=1., finalRate=0.;
     double dr = (finalRate-initialRate)/static_cast<double>(slices-1);
-    // Run a number of slices, adjusting the rates of the non-prefered transitions.
+    // Set up a number of slices, adjusting the rates of the non-prefered transitions, and run them as one batch.
+    BatchCurrentSystem batchSystem(threads);
+    batchSystem.setSeed(seed);
     for (int i=0; i<slices; ++i) {
-      auto start_slice = high_resolution_clock::now();
       double rate = initialRate + i*dr;
-      cout << "Setting demon to " << rate << ".\n";
       system.setDemon_GreaterThan(rate);
-      cout << "Running... ";
-      auto data = system.gatherCurrentStatistics(trials, time);
+      batchSystem.addConfiguration(system);
+    }
+    auto start_slice = high_resolution_clock::now();
+    cout << "Running " << slices << " slices... ";
+    auto data = batchSystem.gatherCurrentStatistics(trials, time);
+    auto end_slice = high_resolution_clock::now();
+    cout << "Done. Time was " << duration_cast<duration<double> >(end_slice-start_slice).count() << ".\n";
+    for (int i=0; i<slices; ++i) {
       string save_name = "incremental-data-" + toString(i) + ".csv";
-      auto end_slice = high_resolution_clock::now();
-      cout << "Done. Saving to [" << save_name << "]. Slice time was " << duration_cast<duration<double> >(end_slice-start_slice).count() << ".\n";
-      writeToFile(save_name, data, time, trials, alpha, beta, gamma, delta, kp, km);
+      writeToFile(save_name, data[i], time, trials, alpha, beta, gamma, delta, kp, km);
     }
   }
 
 
+  // Exact distribution for the small system, written as expected counts for the given number of trials.
+  if (exact) {
+    auto start_exact = high_resolution_clock::now();
+    ExactCurrentSolver solver(system, exact_tol, nmax, fft_size, threads);
+    auto distribution = solver.solve(time);
+    for (auto &pj : distribution) pj.second *= trials;
+    writeToFile(directory+"/exact-data.csv", distribution, time, trials, alpha, beta, gamma, delta, kp, km);
+    auto end_exact = high_resolution_clock::now();
+    cout << "Exact distribution: mean current " << solver.getMean()/time << ", error bounds: Poisson " << solver.getPoissonError()
+         << ", truncation " << solver.getTruncationError() << " (nmax " << solver.getNMax() << "), aliasing "
+         << solver.getAliasingError() << ". Time was " << duration_cast<duration<double> >(end_exact-start_exact).count() << ".\n";
+    if (solver.getTruncationError()>exact_tol)
+      cout << "Warning: the truncation error is above " << exact_tol << " even at nmax " << solver.getNMax() << ".\n";
+    // The truncation error is the only one the solver pays for with time, so it is wasted effort to push it far below
+    // the others.
+    if (solver.getTruncationError()<1e-3*std::max(solver.getPoissonError(), solver.getAliasingError()))
+      cout << "Warning: the truncation error is far below the Poisson and aliasing errors, -exact_tol could be raised.\n";
+  }
+
+  // Long ring: record the total current, the current across link 0 and the entropy production of each segment.
+  if (ring) {
+    auto start_ring = high_resolution_clock::now();
+    ParallelRingSystem parallelRing(sites, particles, segments, kp, km);
+    // The demon slows hops onto sites that are fuller than the one they leave.
+    parallelRing.setDemonRule([=](int nl, int nr) { return nr>nl ? ring_demon : 1.; });
+    parallelRing.setWindow(window);
+    parallelRing.setSeed(seed);
+    auto data = parallelRing.gatherCurrentStatistics(trials, time);
+    writeToFile(directory+"/ring-data.csv", data.reference_counts, time, trials);
+    writeToFile(directory+"/ring-total.csv", data.counts, time, trials);
+    std::ofstream fout(directory+"/ring-entropy.csv");
+    for (int s=0; s<parallelRing.getNSegments(); ++s) fout << s << "," << data.entropy[s] << endl;
+    fout.close();
+    auto end_ring = high_resolution_clock::now();
+    cout << "Ring of " << sites << " sites on " << parallelRing.getNSegments() << " segments. Time was "
+         << duration_cast<duration<double> >(end_ring-start_ring).count() << ".\n";
+  }
+
+  // Compare the current statistics of the parallel and sequential engines on the same small ring.
+  if (ring_check) {
+    LargeCurrentSystem sequential(std::min(sites, 16), std::min(particles, 16));
+    sequential.setDemon_Random(0.1);
+    sequential.setSeed(seed);
+    ParallelRingSystem parallelRing(sequential, segments);
+    parallelRing.setWindow(window);
+    parallelRing.setSeed(seed);
+    auto data1 = sequential.gatherCurrentStatistics(trials, time);
+    auto data2 = parallelRing.gatherCurrentStatistics(trials, time);
+    // Mean and variance of the integrated current.
+    auto moments = [](const map<int, int>& counts) {
+      double n = 0, sum = 0, sumsqr = 0;
+      for (const auto &pj : counts) {
+        n += pj.second;
+        sum += pj.second*static_cast<double>(pj.first);
+        sumsqr += pj.second*static_cast<double>(pj.first)*pj.first;
+      }
+      return std::make_pair(sum/n, sumsqr/n - sum*sum/(n*n));
+    };
+    auto m1 = moments(data1.first), m2 = moments(data2.counts);
+    double z = (m2.first - m1.first)/sqrt((m1.second + m2.second)/trials);
+    cout << "Sequential: mean " << m1.first << ", variance " << m1.second << ". Parallel (" << parallelRing.getNSegments()
+         << " segments, window " << window << "): mean " << m2.first << ", variance " << m2.second << ". z = " << z << ".\n";
+    // The segments chain the demon rates of their own events only, so their entropy production is expected to differ
+    // somewhat from the sequential one, see RingResult.
+    double entropy = 0;
+    for (auto e : data2.entropy) entropy += e;
+    cout << "Demon entropy production: sequential " << data1.second << ", summed over segments " << entropy
+         << ", relative difference " << (entropy - data1.second)/data1.second << ".\n";
+  }
+
   // LargeCurrentSystem mysys(5, 1);
   // mysys.setHomogeneousRates(1.1, 0.9);
   // mysys.setDemon_Random(0.1);
@@ -82,23 +215,76 @@ int main(int argc, char **argv) {
   // cout << "Affinity: " << mysys.getAffinity() << endl;
   // cout << data.first << ", " << data.second << endl;
 
-  if (true) {
+  if (ensemble) {
+    SystemEnsemble systems(5, 5, threads);
+    systems.setTelemetry(telemetry);
+    if (telemetry) telemetry->setTotalTrials(2L*numsys*trials/shard.count);
+    if (batch<1) batch = numsys;
+    for (int first=0; first<numsys; first+=batch) {
+      int count = std::min(batch, numsys-first);
+      systems.generate(count, seed, first);
+      // Gather statistics.
+      auto data1 = systems.gatherShardStatistics(trials, time, shard);
+      // Randomize demons
+      systems.forEach([&](int i, LargeCurrentSystem& largeSystem) {
+        largeSystem.setDemon_Random(0.1, substreamSeed(substreamSeed(seed, first+i), 1));
+      });
+      // Gather statistics.
+      auto data2 = systems.gatherShardStatistics(trials, time, shard);
+      auto start_io = high_resolution_clock::now();
+      for (int i=0; i<count; ++i) {
+        // Create directory
+        string dir = directory + "/" + directory + "-" + toString(first+i) + "/";
+        mkdir(dir.c_str(), 0777);
+        // Write data to files, as the single system runs below do.
+        if (shard.count==1) {
+          double affinity = systems[i].getAffinity(), entropy = data2[i].totalEntropy()/trials;
+          writeToFile(dir+"data1.csv", data1[i].counts, time, trials, affinity, entropy);
+          writeToFile(dir+"data2.csv", data2[i].counts, time, trials, affinity, entropy);
+          writeLargeDeviations(dir, data1[i], data2[i], smin, smax, ns, nboot);
+        }
+        else {
+          writeShard(shardFileName(dir+"data1", shard), data1[i], shard);
+          writeShard(shardFileName(dir+"data2", shard), data2[i], shard);
+        }
+      }
+      if (telemetry) telemetry->addIO(duration_cast<duration<double> >(high_resolution_clock::now()-start_io).count());
+      cout << "Done with runs " << first << " to " << first+count-1 << ".\n";
+    }
+  }
+  else if (!exact && !ring && !ring_check) {
+    // Two sets of trials per system, this shard's share of them.
+    if (telemetry) telemetry->setTotalTrials(2L*numsys*trials/shard.count);
     for (int I=0; I<numsys; ++I) {
       LargeCurrentSystem largeSystem(5, 5);
+      largeSystem.setSeed(substreamSeed(seed, I));
+      largeSystem.setTelemetry(telemetry);
       double affinity = largeSystem.getAffinity();
+      bool single = shard.count==1;
       // Gather statistics.
-      auto data1 = largeSystem.gatherCurrentStatistics(trials, time);
+      auto data1 = largeSystem.gatherShardStatistics(trials, time, shard);
       // Randomize demon
       //largeSystem.setSystem_Random(0.5, 2.);
       largeSystem.setDemon_Random(0.1);
       // Gather statistics.
-      auto data2 = largeSystem.gatherCurrentStatistics(trials, time);
+      auto data2 = largeSystem.gatherShardStatistics(trials, time, shard);
       // Create directory
       string dir = directory + "/" + directory + "-" + toString(I) + "/";
       mkdir(dir.c_str(), 0777);
       // Write data to files.
-      writeToFile(dir+"data1.csv", data1.first, time, trials, affinity, data2.second);
-      writeToFile(dir+"data2.csv", data2.first, time, trials, affinity, data2.second);
+      auto start_io = high_resolution_clock::now();
+      if (single) {
+        double entropy = data2.totalEntropy()/trials;
+        writeToFile(dir+"data1.csv", data1.counts, time, trials, affinity, entropy);
+        writeToFile(dir+"data2.csv", data2.counts, time, trials, affinity, entropy);
+        writeLargeDeviations(dir, data1, data2, smin, smax, ns, nboot);
+      }
+      // Shards write their raw data, to be combined with bin/merge.
+      else {
+        writeShard(shardFileName(dir+"data1", shard), data1, shard);
+        writeShard(shardFileName(dir+"data2", shard), data2, shard);
+      }
+      if (telemetry) telemetry->addIO(duration_cast<duration<double> >(high_resolution_clock::now()-start_io).count());
 
       cout << "Done with run " << I << ".\n";
     }
@@ -126,9 +312,7 @@ int main(int argc, char **argv) {
     writeToFile(directory+"data2-occ.csv", occupation, occ_size);
 
     // Write demon function to file.
-    int demon_size = system.getDemonSize();
-    double **demon = system.getDemonFunction();
-    writeToFile(directory+"demon-function.csv", demon, demon_size);
+    system.getDemonFunction().writeToFile(directory+"demon-function.csv");
     
     // Write current data to files.
     writeToFile(directory+"data1.csv", data1, time, trials, alpha, beta, gamma, delta, kp, km);
@@ -140,5 +324,10 @@ int main(int argc, char **argv) {
   duration<double> span = duration_cast<duration<double> >(end_time-start_time);
   cout << "Finished running. Time: " << span.count() << ".\n";
 
+  if (telemetry) {
+    telemetry->flush();
+    delete telemetry;
+  }
+
   return 0;
 }
@@ -0,0 +1,30 @@
+#include "ensemble.hpp"
+
+SystemEnsemble::SystemEnsemble(int s, int p, int t) : nstates(s), nparticles(p), nthreads(t) {};
+
+void SystemEnsemble::generate(int count, unsigned seed, int first) {
+  // Release the last batch.
+  systems.clear();
+  arena.reset();
+  // Allocate the systems. The arena is not thread safe, so this is done on one thread.
+  systems.reserve(count);
+  for (int i=0; i<count; ++i) systems.emplace_back(nstates, nparticles, arena);
+  // Randomize them, which only writes to each system's own tables.
+  forEach([&](int i, LargeCurrentSystem& system) {
+    system.randomize(substreamSeed(seed, first+i));
+    system.setTelemetry(telemetry);
+  });
+}
+
+void SystemEnsemble::setTelemetry(Telemetry *t) {
+  telemetry = t;
+  for (auto &system : systems) system.setTelemetry(telemetry);
+}
+
+vector<ShardData> SystemEnsemble::gatherShardStatistics(int trials, double time, const Shard& shard) {
+  vector<ShardData> data(systems.size());
+  forEach([&](int i, LargeCurrentSystem& system) {
+    data[i] = system.gatherShardStatistics(trials, time, shard);
+  });
+  return data;
+}
@@ -0,0 +1,53 @@
+#ifndef __ENSEMBLE_HPP__
+#define __ENSEMBLE_HPP__
+
+#include "large-current.hpp"
+
+//! \brief A batch of random LargeCurrentSystems whose tables all live in one arena.
+//!
+//! Each call to generate releases the previous batch and builds the next one in the same memory, so after the first
+//! batch the tables of the systems (rates, occupations and demon functions) do not touch the heap. The definitions of
+//! the demon functions (the rules and layers of each DemonTable) and the histograms the systems return still do.
+class SystemEnsemble {
+public:
+  //! \brief Constructor, takes the number of states and particles of each system, and the number of threads to use
+  //! (0 means one per core).
+  SystemEnsemble(int, int, int=0);
+
+  //! \brief Replace the systems by a new batch of random systems. System i of the batch is randomized from substream
+  //! first+i of the seed, so a job split into batches gets the same systems as a single batch. The systems are
+  //! allocated one after another, as the arena is not thread safe, and then randomized in parallel.
+  void generate(int, unsigned, int=0);
+
+  //! \brief The number of systems in the batch.
+  int size() const { return systems.size(); }
+
+  //! \brief Access a system.
+  LargeCurrentSystem& operator[](int i) { return systems[i]; }
+
+  //! \brief Call fn(i, system) for every system, in parallel.
+  template<typename F> void forEach(F fn) {
+    parallelFor(systems.size(), nthreads, [&](int i) { fn(i, systems[i]); });
+  }
+
+  //! \brief Gather this shard's blocks of current statistics for every system, in parallel.
+  vector<ShardData> gatherShardStatistics(int, double, const Shard& =Shard());
+
+  //! \brief Report the work done gathering statistics to a telemetry object, or nothing if null. Applies to the
+  //! current batch and every batch generated after it.
+  void setTelemetry(Telemetry*);
+
+  //! \brief The number of bytes of table memory in use.
+  size_t getArenaBytes() const { return arena.getUsed(); }
+
+private:
+  int nstates, nparticles, nthreads;
+
+  Arena arena;
+
+  Telemetry *telemetry = nullptr;
+
+  vector<LargeCurrentSystem> systems;
+};
+
+#endif // __ENSEMBLE_HPP__
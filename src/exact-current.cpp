@@ -0,0 +1,187 @@
+#include "exact-current.hpp"
+
+namespace {
+  //! \brief In place radix 2 FFT, computing sum_m a_m exp(-2 pi i m k / n). The size must be a power of two.
+  void fft(vector<complex<double> >& a) {
+    const int n = a.size();
+    // Bit reversal permutation.
+    for (int i=1, j=0; i<n; ++i) {
+      int bit = n >> 1;
+      for (; j & bit; bit >>= 1) j ^= bit;
+      j ^= bit;
+      if (i<j) std::swap(a[i], a[j]);
+    }
+    // Butterflies.
+    for (int len=2; len<=n; len <<= 1) {
+      double angle = -2*M_PI/len;
+      for (int i=0; i<n; i+=len)
+        for (int k=0; k<len/2; ++k) {
+          complex<double> w = std::polar(1., angle*k);
+          complex<double> u = a[i+k], v = a[i+k+len/2]*w;
+          a[i+k] = u + v;
+          a[i+k+len/2] = u - v;
+        }
+    }
+  }
+
+  //! \brief Poisson probability of n events with mean mu.
+  inline double poisson(int n, double mu) {
+    return exp(-mu + n*log(mu) - lgamma(n+1.));
+  }
+
+  //! \brief The number of uniformization steps needed for a Poisson mean mu.
+  inline int poissonSteps(double mu) {
+    return static_cast<int>(ceil(mu + 10*sqrt(mu) + 20));
+  }
+}
+
+ExactCurrentSolver::ExactCurrentSolver(const CurrentSystem& system, double tol, int n, int f, int t)
+  : alpha(system.get_alpha()), beta(system.get_beta()), gamma(system.get_gamma()), delta(system.get_delta()),
+    kp(system.get_kp()), km(system.get_km()), demon(system.getDemonFunction()), tolerance(tol), max_nmax(n), nthreads(t) {
+  if (max_nmax<1) max_nmax = 1;
+  // Round the FFT size up to a power of two.
+  fft_size = 2;
+  while (fft_size<f) fft_size <<= 1;
+}
+
+void ExactCurrentSolver::truncate(int n) {
+  nmax = n;
+  const int side = nmax+1;
+  nstates = side*side;
+
+  // Rates and targets of each transition, in the order of the transition types of CurrentSystem.
+  vector<double> rate[ntypes];
+  for (int c=0; c<ntypes; ++c) {
+    rate[c] = vector<double>(nstates, 0.);
+    target[c] = vector<int>(nstates, -1);
+  }
+  const int dl[ntypes] = {1, 0, -1, 0, -1, 1}, dr[ntypes] = {0, 1, 0, -1, 1, -1};
+  flux = vector<double>(nstates, 0.);
+  vector<double> exit(nstates, 0.);
+  for (int nl=0; nl<side; ++nl)
+    for (int nr=0; nr<side; ++nr) {
+      int s = nl*side + nr;
+      // Same treatment of the demon rate as CurrentSystem::runCurrent. We use 1e-5 as "effectively zero."
+      double demon_rate = demon.evaluate(0, nl, nr);
+      if (demon_rate<=0) demon_rate = 1e-5;
+      rate[0][s] = alpha;
+      rate[1][s] = delta;
+      rate[2][s] = nl*gamma;
+      rate[3][s] = nr*beta;
+      rate[4][s] = nl*kp*demon_rate;
+      rate[5][s] = nr*km*demon_rate;
+      flux[s] = rate[4][s] - rate[5][s];
+      for (int c=0; c<ntypes; ++c) {
+        exit[s] += rate[c][s];
+        // Transitions out of the truncated space are lost.
+        int l = nl + dl[c], r = nr + dr[c];
+        if (rate[c][s]>0 && l<side && r<side) target[c][s] = l*side + r;
+      }
+    }
+
+  // Uniformize.
+  Lambda = *std::max_element(exit.begin(), exit.end());
+  self = vector<double>(nstates);
+  for (int s=0; s<nstates; ++s) self[s] = 1. - exit[s]/Lambda;
+  for (int c=0; c<ntypes; ++c) {
+    probability[c] = vector<double>(nstates);
+    for (int s=0; s<nstates; ++s) probability[c][s] = rate[c][s]/Lambda;
+  }
+}
+
+map<int, double> ExactCurrentSolver::solve(double time) {
+  map<int, double> distribution;
+  if (time<=0) {
+    distribution[0] = 1.;
+    return distribution;
+  }
+
+  // Grow the truncation until little enough probability leaves it. Each try costs a single propagation, little next
+  // to the FFT grid of them below.
+  complex<double> G0;
+  for (int n=1; ; ++n) {
+    truncate(n);
+    G0 = propagate(0., time, &mean);
+    if (1. - G0.real()<=tolerance || n>=max_nmax) break;
+  }
+
+  // Missing weight of the truncated uniformization series.
+  const double mu = Lambda*time;
+  double included = 0;
+  for (int n=0, R=poissonSteps(mu); n<=R; ++n) included += poisson(n, mu);
+  poisson_error = std::max(0., 1. - included);
+
+  // Characteristic function. G(-theta) is the conjugate of G(theta), so only half the grid is needed.
+  const int half = fft_size/2;
+  vector<complex<double> > G(fft_size);
+  G[0] = G0;
+  parallelFor(half, nthreads, [&](int m) {
+    G[m+1] = propagate(2*M_PI*(m+1)/fft_size, time, nullptr);
+  });
+  for (int m=1; m<half; ++m) G[fft_size-m] = std::conj(G[m]);
+  truncation_error = std::max(0., 1. - G[0].real());
+
+  // Center the J window on the mean: P(c+k) = 1/M sum_m G(theta_m) exp(-i theta_m c) exp(-2 pi i m k/M).
+  const long center = std::lround(mean);
+  for (int m=0; m<fft_size; ++m) {
+    long shift = ((m*center) % fft_size + fft_size) % fft_size;
+    G[m] *= std::polar(1., -2*M_PI*shift/fft_size);
+  }
+  fft(G);
+
+  // Read off the distribution, dropping round off noise.
+  double total = 0, sum = 0, sumsqr = 0;
+  for (int j=0; j<fft_size; ++j) {
+    int k = j<half ? j : j-fft_size;
+    double P = G[j].real()/fft_size;
+    if (P<1e-15) continue;
+    int J = center + k;
+    distribution[J] = P;
+    total += P;
+    sum += P*J;
+    sumsqr += P*J*J;
+  }
+
+  // Chebyshev bound on the probability that falls outside the window.
+  if (total>0) {
+    double m1 = sum/total, var = sumsqr/total - m1*m1;
+    double distance = half - 1 - std::fabs(mean - center);
+    aliasing_error = distance>0 ? std::min(1., var/(distance*distance)) : 1.;
+  }
+
+  return distribution;
+}
+
+complex<double> ExactCurrentSolver::propagate(double theta, double time, double *mean_current) const {
+  const double mu = Lambda*time;
+  const int R = poissonSteps(mu);
+  // Phases of the transition types, only the current carrying ones are tilted.
+  const complex<double> phase[ntypes] = {1., 1., 1., 1., std::polar(1., theta), std::polar(1., -theta)};
+
+  vector<complex<double> > v(nstates, 0.), w(nstates);
+  // Start from the empty system.
+  v[0] = 1.;
+  complex<double> G = 0.;
+  double cdf = 0, current = 0;
+  for (int n=0; n<=R; ++n) {
+    double weight = poisson(n, mu);
+    complex<double> total = 0.;
+    for (int s=0; s<nstates; ++s) total += v[s];
+    G += weight*total;
+    // The mean current is the integral of the mean flux, int_0^t p(u) du = 1/Lambda sum_n P(N(t)>n) v_n.
+    if (mean_current) {
+      cdf += weight;
+      double f = 0;
+      for (int s=0; s<nstates; ++s) f += v[s].real()*flux[s];
+      current += std::max(0., 1.-cdf)/Lambda*f;
+    }
+    // Uniformization step.
+    for (int s=0; s<nstates; ++s) w[s] = self[s]*v[s];
+    for (int c=0; c<ntypes; ++c)
+      for (int s=0; s<nstates; ++s)
+        if (target[c][s]>=0) w[target[c][s]] += probability[c][s]*phase[c]*v[s];
+    v.swap(w);
+  }
+  if (mean_current) *mean_current = current;
+  return G;
+}
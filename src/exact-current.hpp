@@ -0,0 +1,80 @@
+#ifndef __EXACT_CURRENT_HPP__
+#define __EXACT_CURRENT_HPP__
+
+#include "current.hpp"
+
+#include <complex>
+using std::complex;
+
+//! \brief Computes the exact finite time distribution of the integrated current of a CurrentSystem, the distribution
+//! that gatherCurrentStatistics samples.
+//!
+//! The (nl, nr) state space is truncated at nmax, the smallest one whose truncation error (see below) at the requested
+//! time is within a tolerance. The cost grows quickly with nmax, as both the number of states and the uniformization
+//! rate, which is set by the fullest state, grow with it. For each counting field theta on an FFT grid, the tilted generator,
+//! whose J changing transitions carry a phase exp(+-i theta), is exponentiated against the initial state by
+//! uniformization, giving the characteristic function G(theta) = <exp(i theta J)>. An inverse FFT turns this into the
+//! distribution of J on a window of fft_size values around the mean. The three sources of error are bounded:
+//!   - Poisson: the uniformization series is truncated, its missing weight bounds the error of every G(theta).
+//!   - Truncation: probability that leaves the truncated state space, 1 - G(0), bounds the error of every P(J).
+//!   - Aliasing: probability outside the J window folds back into it. Bounded with Chebyshev's inequality.
+class ExactCurrentSolver {
+public:
+  //! \brief Constructor, takes the system, the tolerance on the truncation error, the largest occupation to keep even
+  //! if the tolerance is not met, the FFT size (rounded up to a power of two), and the number of threads (0 means one
+  //! per core).
+  ExactCurrentSolver(const CurrentSystem&, double=1e-6, int=64, int=1024, int=0);
+
+  //! \brief Compute the distribution of the integrated current at a time, as a map of (J, probability). Grows the
+  //! truncation one occupation at a time, from nothing, until the truncation error is within the tolerance.
+  map<int, double> solve(double);
+
+  //! \brief The largest occupation kept by the last solve.
+  int getNMax() const { return nmax; }
+
+  double getPoissonError() const    { return poisson_error; }
+  double getTruncationError() const { return truncation_error; }
+  double getAliasingError() const   { return aliasing_error; }
+
+  //! \brief The mean of the integrated current.
+  double getMean() const { return mean; }
+
+private:
+  //! \brief The number of transition types of a CurrentSystem.
+  static const int ntypes = 6;
+
+  //! \brief Set up the uniformized generator of the state space truncated at n.
+  void truncate(int);
+
+  //! \brief Propagate the initial state with the generator tilted by theta, return sum_s [exp(time W) p0]_s. If mean
+  //! is not null, also compute the mean integrated current (only meaningful for theta = 0).
+  complex<double> propagate(double, double, double*) const;
+
+  //! \brief The parameters of the system.
+  double alpha, beta, gamma, delta, kp, km;
+  DemonTable demon;
+
+  double tolerance;
+  int nmax = 0, max_nmax, fft_size, nthreads;
+
+  //! \brief The number of states, (nmax+1)^2.
+  int nstates;
+
+  //! \brief Uniformization rate.
+  double Lambda;
+
+  //! \brief For each transition type and state, the target state (-1 if it leaves the state space or has no rate)
+  //! and the rate divided by Lambda.
+  vector<int> target[ntypes];
+  vector<double> probability[ntypes];
+
+  //! \brief The probability of staying put in a uniformization step.
+  vector<double> self;
+
+  //! \brief The mean current leaving each state.
+  vector<double> flux;
+
+  double poisson_error = 0., truncation_error = 0., aliasing_error = 0., mean = 0.;
+};
+
+#endif // __EXACT_CURRENT_HPP__
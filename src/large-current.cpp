@@ -1,152 +1,135 @@
 #include "large-current.hpp"
 
-LargeCurrentSystem::LargeCurrentSystem(int s, int p) : nstates(s), nparticles(p) {
+LargeCurrentSystem::LargeCurrentSystem(int s, int p) : nstates(s), nparticles(p), demons(s, std::min(p+1, 8)) {
+  allocate(nullptr);
   // Set up random number generators.
-  unsigned seed = static_cast<unsigned>(std::chrono::system_clock::now().time_since_epoch().count());
-  generator = std::default_random_engine(seed);
+  seed = static_cast<unsigned>(std::chrono::system_clock::now().time_since_epoch().count());
+  generator = RandomEngine(seed);
   distribution = std::exponential_distribution<float>(1.0);
 
-  // Create vector of demon functions.
-  demon_functions = vector<double**>(nstates, nullptr);
-  // Calculate demon size.
-  demon_size = std::min(max_demon_function_size, nparticles+1);
-  // Create initial demon function - set all rate modifiers to 1.
-  for (auto &df : demon_functions) {
-    df = new double*[max_demon_function_size];
-    for (int i=0; i<max_demon_function_size; ++i) {
-      df[i] = new double[max_demon_function_size];
-      for (int j=0; j<max_demon_function_size; ++j)
-        df[i][j] = 1.;
-    }
-  }
-
   // Initialize rates
   const double maxRp = 1.5, minRp = 0.5, maxRm = 1.0, minRm = 0.1;
   for (int i=0; i<nstates; ++i) {
-    double kp = drand48()*(maxRp - minRp) + minRp;
-    double km = drand48()*(maxRm - minRm) + minRm;
-    Kpos.push_back(kp);
-    Kneg.push_back(km);
+    Kpos[i] = drand48()*(maxRp - minRp) + minRp;
+    Kneg[i] = drand48()*(maxRm - minRm) + minRm;
   }
 
   // Initialize particle positions.
-  occupation = vector<int>(nstates);
   for (int i=0; i<nparticles; ++i) {
     int s = drand48()*nstates;
     ++occupation[s];
   }
+  std::copy(occupation, occupation+nstates, initial_occupation);
 }
 
-LargeCurrentSystem::~LargeCurrentSystem() {
-  for (auto df : demon_functions) 
-    if (df) delete df;
+LargeCurrentSystem::LargeCurrentSystem(int s, int p, Arena& arena)
+  : nstates(s), nparticles(p), demons(s, p+1, allocate(&arena)) {
+  distribution = std::exponential_distribution<float>(1.0);
+  setSeed(0);
 }
 
-pair<int, double> LargeCurrentSystem::runSystem(double runtime) {
-
-  double time = 0;
-  auto expnum = std::bind(distribution, generator);
-  int J = 0;
-  double current_demon_rate = 1., last_demon_rate = 1.;
-  double demon_entropy = 0;
-
-  // Run for as long as requested.
-  while (time<runtime) {
-
-    int state = -1, dir = 0;
-    double rate = 1., demon_rate = 1., event = 1., minevent = 1000000.;
-
-    // Look through all potential rates
-    for (int i=0; i<nstates; ++i) {
-      // Occupation of this and the other site.
-      int occ1 = occupation[i], occ2;
-
-      // If there are no particles here, no transition from here can occur.
-      if (occ1==0) continue;
-
-      // Calculate next forward event.
-      int ip1 = (i+1) % nstates;
-      occ2 = occupation[ip1];
-      demon_rate = (occ1<demon_size && occ2 < demon_size) ? demon_functions[i][occ1][occ2] : 1.;
-      rate = Kpos[i]*demon_rate;
-      // Check if the rate is the minimal rate so far.
-      if (rate>0) {
-        event = distribution(generator)/(occ1*rate);
-        if (event < minevent) {
-          minevent = event;
-          current_demon_rate = demon_rate;
-          state = i;
-          dir = 1;
-        }
-      }
-
-      // Calculate next backwards event.
-      int ip2 = i==0 ? nstates-1 : i-1;
-      occ2 = occupation[ip2];
-      demon_rate = (occ1<demon_size && occ2 < demon_size) ? demon_functions[ip2][occ2][occ1] : 1.;
-
-      rate = Kneg[ip2]*demon_rate;
-      // Check if the rate is the minimal rate so far.
-      if (rate>0) {
-        event = distribution(generator)/(occ1*rate);
-        if (event < minevent) {
-          minevent = event;
-          current_demon_rate = demon_rate;
-          state = i;
-          dir = -1;
-        }
-      }
-    }
-
-    // We have checked all rates. Check if there are any good ones.
-    if (state==-1) {
-      cout << "Error: no transitions available. Exiting.";
-      return std::make_pair(-1, 0.);
-    }
-
-    --occupation[state];
-    if (dir==1) {
-      ++occupation[(state+1) % nstates];
-      ++J;
-    }
-    else if (dir==-1) {
-      int s2 = state>0 ? state-1 : nstates-1;
-      ++occupation[s2];
-      --J;
-    }
-
-    // Count change in entropy.
-    demon_entropy += dir*log(current_demon_rate/last_demon_rate);
-
-    // Set last demon rate.
-    last_demon_rate = current_demon_rate;
+double* LargeCurrentSystem::allocate(Arena *arena) {
+  // In an arena, the demon functions cover every occupation a site can have, as they cannot grow.
+  int demon_capacity = nparticles+1;
+  int demon_entries = arena ? nstates*demon_capacity*demon_capacity : 0;
+  // Rates and demon functions are laid out contiguously: Kpos, Kneg, demon functions.
+  if (arena) {
+    Kpos = arena->allocate<double>(2*nstates + demon_entries);
+    occupation = arena->allocate<int>(2*nstates);
+  }
+  else {
+    storage = vector<double>(2*nstates + demon_entries);
+    int_storage = vector<int>(2*nstates);
+    Kpos = storage.data();
+    occupation = int_storage.data();
+  }
+  Kneg = Kpos + nstates;
+  initial_occupation = occupation + nstates;
+  // Initialize. The demon table sets its own entries to 1.
+  std::fill(Kpos, Kpos + 2*nstates, 1.);
+  std::fill(occupation, occupation + 2*nstates, 0);
+  return arena ? Kneg + nstates : nullptr;
+}
 
-    // Increment time
-    time += event;
+void LargeCurrentSystem::randomize(unsigned sd) {
+  std::default_random_engine engine(sd);
+  std::uniform_real_distribution<double> uniform(0., 1.);
+  // Initialize rates, over the same ranges as the constructor.
+  const double maxRp = 1.5, minRp = 0.5, maxRm = 1.0, minRm = 0.1;
+  for (int i=0; i<nstates; ++i) {
+    Kpos[i] = uniform(engine)*(maxRp - minRp) + minRp;
+    Kneg[i] = uniform(engine)*(maxRm - minRm) + minRm;
   }
+  // Reset demon functions.
+  demons.setRule([](int, int, int) { return 1.; });
+  // Initialize particle positions.
+  std::fill(occupation, occupation + nstates, 0);
+  for (int i=0; i<nparticles; ++i) ++occupation[static_cast<int>(uniform(engine)*nstates) % nstates];
+  std::copy(occupation, occupation+nstates, initial_occupation);
+  // The trials get their own substreams.
+  setSeed(substreamSeed(sd, 0));
+  generator.seed(seed);
+}
 
-  // Return the current.
-  return std::make_pair(J, demon_entropy/runtime);
+pair<int, double> LargeCurrentSystem::runSystem(double runtime) {
+  EntropyObserver entropy;
+  int J = runSystem(runtime, entropy);
+  // Return the current and the rate of entropy production.
+  return std::make_pair(J, entropy.getEntropy()/runtime);
 }
 
 pair<map<int, int>, double> LargeCurrentSystem::gatherCurrentStatistics(int trials, double time) {
-  // Count currents.
-  map<int, int> counts;
-  double entropy_production = 0;
-
-  for (int i=0; i<trials; ++i) {
-    // Run for the time and see what (integrated) current we get.
-    auto data = runSystem(time);
-    int J = data.first;
-    entropy_production += data.second;
-    // Record the current.
-    auto it = counts.find(J);
-    if (it==counts.end()) counts.insert(pair<int, int>(J, 1));
-    else ++it->second;
+  // Run all the trials as a single shard.
+  ShardData data = gatherShardStatistics(trials, time, Shard());
+  // Return the map
+  return std::make_pair(data.counts, data.totalEntropy()/trials);
+}
+
+ShardData LargeCurrentSystem::gatherShardStatistics(int trials, double time, const Shard& shard) {
+  ShardData data;
+  data.time = time;
+  data.seed = seed;
+  data.trials = trials;
+  data.affinity = getAffinity();
+  // Each call gets its own substreams, so gathering twice does not repeat the same trials.
+  unsigned call_seed = substreamSeed(seed, gathers++);
+
+  int nblocks = numberOfBlocks(trials);
+  for (int b=shard.firstBlock(nblocks); b<shard.lastBlock(nblocks); ++b) {
+    // Start the block's substream from the initial particle positions.
+    generator.seed(substreamSeed(call_seed, b));
+    std::copy(initial_occupation, initial_occupation+nstates, occupation);
+    double entropy_production = 0;
+    // With telemetry, also count the kernel's work and time each trial.
+    TelemetryObserver monitor;
+    int first = b*shard_block_size, last = std::min(trials, first + shard_block_size);
+    for (int i=first; i<last; ++i) {
+      // Run for the time and see what (integrated) current we get.
+      pair<int, double> trial;
+      if (telemetry) {
+        auto start = high_resolution_clock::now();
+        EntropyObserver entropy;
+        auto monitored = observe(entropy, monitor);
+        int J = runSystem(time, monitored);
+        trial = std::make_pair(J, entropy.getEntropy()/time);
+        monitor.addTrial(duration_cast<duration<double> >(high_resolution_clock::now()-start).count());
+      }
+      else trial = runSystem(time);
+      int J = trial.first;
+      entropy_production += trial.second;
+      // Record the current.
+      auto it = data.counts.find(J);
+      if (it==data.counts.end()) data.counts.insert(pair<int, int>(J, 1));
+      else ++it->second;
+    }
+    data.entropy[b] = entropy_production;
+    if (telemetry) {
+      telemetry->add(monitor);
+      telemetry->report();
+    }
   }
 
-  // Return the map
-  return std::make_pair(counts, entropy_production/trials);
+  return data;
 }
 
 double LargeCurrentSystem::getAffinity() {
@@ -159,25 +142,29 @@ double LargeCurrentSystem::getAffinity() {
 }
 
 void LargeCurrentSystem::setHomogeneousRates(double kp, double km) {
-  for (auto &k : Kpos) k = kp;
-  for (auto &k : Kneg) k = km;
+  std::fill(Kpos, Kpos+nstates, kp);
+  std::fill(Kneg, Kneg+nstates, km);
 }
 
 void LargeCurrentSystem::setDemon_Random(double min) {
   if (min==0) return;
   // Set rates.
-  for (auto &df : demon_functions)
-    for (int nl=0; nl<demon_size; ++nl)
-      for (int nr=nl+1; nr<demon_size; ++nr)
-        df[nl][nr] = drand48()*(1.-min) + min;
+  setDemon_Random(min, static_cast<unsigned>(drand48()*4294967296.));
+}
+
+void LargeCurrentSystem::setDemon_Random(double min, unsigned sd) {
+  if (min==0) return;
+  // Set rates.
+  demons.setRule(DemonTable::uphill, DemonTable::randomRule(sd, min, 1.));
 }
 
 void LargeCurrentSystem::setSystem_Random(double min, double max) {
   if (min==0) return;
   if (max>min) std::swap(min, max);
   // Set rates.
-  for (auto &df : demon_functions)
-    for (int nl=0; nl<demon_size; ++nl)
-      for (int nr=0; nr<demon_size; ++nr)
-        df[nl][nr] = drand48()*(max-min) + min;
+  demons.setRule(DemonTable::randomRule(static_cast<unsigned>(drand48()*4294967296.), min, max));
+}
+
+void LargeCurrentSystem::setDemonRule(DemonTable::Rule rule) {
+  demons.setRule(rule);
 }
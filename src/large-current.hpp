@@ -2,29 +2,77 @@
 #define __LARGE_CURRENT_HPP__
 
 #include "utility.hpp"
+#include "telemetry.hpp"
+#include "shard.hpp"
+#include "arena.hpp"
+#include "demon-table.hpp"
 
 class LargeCurrentSystem {
 public:
   //! \brief Constructor, takes the number of states, and the number of particles.
   LargeCurrentSystem(int, int);
 
-  //! \brief Destructor - we have to clean up the demon functions.
-  ~LargeCurrentSystem();
+  //! \brief Constructor that takes all of its tables from an arena instead of the heap. The rates start out at 1 and
+  //! no particles are placed, so call randomize before running the system.
+  LargeCurrentSystem(int, int, Arena&);
 
-  //! \brief Run the simulation for some amount of time, and record the current.
+  // The tables may belong to an arena, so systems can be moved but not copied.
+  LargeCurrentSystem(const LargeCurrentSystem&) = delete;
+  LargeCurrentSystem& operator=(const LargeCurrentSystem&) = delete;
+  LargeCurrentSystem(LargeCurrentSystem&&) = default;
+  LargeCurrentSystem& operator=(LargeCurrentSystem&&) = default;
+
+  //! \brief Run the simulation for some amount of time, and record the current and the demon entropy production.
   pair<int, double> runSystem(double);
 
+  //! \brief Run the simulation for some amount of time, return the current. The observer is notified of every
+  //! dwell and transition, see observers.hpp.
+  template<typename Observer> int runSystem(double, Observer&);
+
   //! \brief Run many trials of the same system, return a map of (integrated current value, number of occurences).
   pair<map<int, int>, double> gatherCurrentStatistics(int, double);
 
+  //! \brief Run this shard's blocks of a set of trials. Each block starts from the initial particle positions and runs
+  //! on its own random substream, derived from the seed, so the shards of a job can be run anywhere and merged.
+  ShardData gatherShardStatistics(int, double, const Shard&);
+
+  //! \brief Set the seed that the random substreams of the trials are derived from.
+  void setSeed(unsigned s) { seed = s; gathers = 0; }
+
+  //! \brief Report the work done gathering statistics to a telemetry object, or nothing if null.
+  void setTelemetry(Telemetry *t) { telemetry = t; }
+
   //! \brief Compute and return the affinity of the loop.
   double getAffinity();
 
   void setHomogeneousRates(double=1., double=1.);
 
-  //! \brief 
+  //! \brief Randomize the rates and particle positions and reset the demon functions, using a generator seeded with
+  //! the given seed. Unlike the constructor, this does not touch drand48, so it is safe to call from several threads.
+  void randomize(unsigned);
+
+  //! \brief Set the demon function entries where nr>nl to random numbers between min and 1.
   void setDemon_Random(double=0.5);
 
+  //! \brief As setDemon_Random, but draw from a generator seeded with the given seed rather than from drand48.
+  void setDemon_Random(double, unsigned);
+
+  //! \brief Define the demon functions by a rule of (link, nl, nr), where link i connects site i to site i+1.
+  void setDemonRule(DemonTable::Rule);
+
+  //! \brief Get the demon functions.
+  const DemonTable& getDemonFunctions() const { return demons; }
+
+  //! \brief Get the forward and backward rate of a link.
+  double getKpos(int i) const { return Kpos[i]; }
+  double getKneg(int i) const { return Kneg[i]; }
+
+  //! \brief Get the occupation of a site at construction, which each block of trials starts from.
+  int getInitialOccupation(int i) const { return initial_occupation[i]; }
+
+  int getNStates() const { return nstates; }
+  int getNParticles() const { return nparticles; }
+
   //! \brief 
   void setSystem_Random(double=0.5, double=1.0);
 
@@ -36,23 +84,134 @@ private:
   //! \brief The number of particles in the system.
   int nparticles = 3;
 
-  //! \brief The maximum grid size of each demon function.
-  int max_demon_function_size = 5;
-
-  //! \brief The actual demon size.
-  int demon_size;
-
-  //! \brief A vector of the demon functions.
-  vector<double**> demon_functions;
+  //! \brief Allocate the tables, from the arena if there is one, otherwise from owned storage. With an arena, returns
+  //! the memory for the demon functions, otherwise null, as they own their memory. Called while constructing demons, so
+  //! it may only touch the members declared before it.
+  double* allocate(Arena*);
 
   //! \brief Positive and negative transition rates.
-  vector<double> Kpos, Kneg;
+  double *Kpos = nullptr, *Kneg = nullptr;
 
   //! \brief Site occupation.
-  vector<int> occupation;
+  int *occupation = nullptr;
+
+  //! \brief Site occupation at construction, which each block of trials starts from.
+  int *initial_occupation = nullptr;
+
+  //! \brief Storage for the tables, if they do not come from an arena.
+  vector<double> storage;
+  vector<int> int_storage;
+
+  //! \brief The demon functions of all links. They start out small and grow as occupations are reached, see runSystem.
+  //! Tables in an arena cannot grow, so arena backed systems construct them directly on the memory from allocate, with
+  //! room for every occupation up to nparticles.
+  DemonTable demons;
+
+  //! \brief The seed the random substreams are derived from, and the number of times statistics have been gathered.
+  unsigned seed;
+  unsigned gathers = 0;
+
+  //! \brief Telemetry to report to, if any.
+  Telemetry *telemetry = nullptr;
 
-  std::default_random_engine generator;
+  RandomEngine generator;
   std::exponential_distribution<float> distribution;
 };
 
-#endif // __LARGE_CURRENT_HPP__
\ No newline at end of file
+template<typename Observer> int LargeCurrentSystem::runSystem(double runtime, Observer& observer) {
+  double time = 0;
+  int J = 0;
+  // The demon functions cover every occupation below their capacity, so they only have to be checked when an
+  // occupation increases, not when a rate is looked up.
+  int demon_capacity = demons.getCapacity();
+  const double *demon_table = demons.data();
+  auto reserve = [&](int n) {
+    if (n<demon_capacity) return;
+    demons.reserve(n);
+    demon_capacity = demons.getCapacity();
+    demon_table = demons.data();
+  };
+  auto demon = [&](int link, int nl, int nr) { return demon_table[(link*demon_capacity + nl)*demon_capacity + nr]; };
+  reserve(*std::max_element(occupation, occupation+nstates));
+
+  // Run for as long as requested.
+  while (time<runtime) {
+
+    int state = -1, dir = 0;
+    double rate = 1., demon_rate = 1., current_demon_rate = 1., event = 1., minevent = 1000000.;
+
+    // Look through all potential rates
+    for (int i=0; i<nstates; ++i) {
+      // Occupation of this and the other site.
+      int occ1 = occupation[i], occ2;
+
+      // If there are no particles here, no transition from here can occur.
+      if (occ1==0) continue;
+
+      // Calculate next forward event.
+      int ip1 = (i+1) % nstates;
+      occ2 = occupation[ip1];
+      demon_rate = demon(i, occ1, occ2);
+      rate = Kpos[i]*demon_rate;
+      // Check if the rate is the minimal rate so far.
+      if (rate>0) {
+        event = distribution(generator)/(occ1*rate);
+        if (event < minevent) {
+          minevent = event;
+          current_demon_rate = demon_rate;
+          state = i;
+          dir = 1;
+        }
+      }
+
+      // Calculate next backwards event.
+      int ip2 = i==0 ? nstates-1 : i-1;
+      occ2 = occupation[ip2];
+      demon_rate = demon(ip2, occ2, occ1);
+
+      rate = Kneg[ip2]*demon_rate;
+      // Check if the rate is the minimal rate so far.
+      if (rate>0) {
+        event = distribution(generator)/(occ1*rate);
+        if (event < minevent) {
+          minevent = event;
+          current_demon_rate = demon_rate;
+          state = i;
+          dir = -1;
+        }
+      }
+    }
+
+    // We have checked all rates. Check if there are any good ones.
+    if (state==-1) {
+      cout << "Error: no transitions available. Exiting.";
+      return -1;
+    }
+
+    // Record the time spent in this state.
+    observer.dwell(occupation, nstates, minevent);
+
+    --occupation[state];
+    if (dir==1) {
+      int s2 = (state+1) % nstates;
+      ++occupation[s2];
+      reserve(occupation[s2]);
+      ++J;
+    }
+    else if (dir==-1) {
+      int s2 = state>0 ? state-1 : nstates-1;
+      ++occupation[s2];
+      reserve(occupation[s2]);
+      --J;
+    }
+    observer.transition(state, dir, current_demon_rate);
+
+    // Increment time
+    time += minevent;
+  }
+
+  // Return the current.
+  return J;
+}
+
+#endif // __LARGE_CURRENT_HPP__
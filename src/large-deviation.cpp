@@ -0,0 +1,112 @@
+#include "large-deviation.hpp"
+
+LargeDeviationEstimator::LargeDeviationEstimator(double t, double smin, double smax, int ns, int nb, unsigned seed) : time(t), nboot(nb), generator(seed) {
+  // Need at least one tilt.
+  if (ns<1) ns = 1;
+  // Set up the grid of tilts.
+  double ds = ns>1 ? (smax-smin)/static_cast<double>(ns-1) : 0.;
+  for (int i=0; i<ns; ++i) tilts.push_back(smin + i*ds);
+  // Set up accumulators.
+  accumulators = vector<LogSumExp>(ns);
+  if (nboot<0) nboot = 0;
+  bootstrap = vector<LogSumExp>(nboot*ns);
+  bootstrap_weight = vector<double>(nboot, 0.);
+  // Bootstrap replicates weigh each trial by a Poisson(1) count.
+  poisson = std::poisson_distribution<int>(1.0);
+}
+
+void LargeDeviationEstimator::addTrial(int J) {
+  const int ns = tilts.size();
+  for (int i=0; i<ns; ++i) accumulators[i].add(tilts[i]*J);
+  // Update the bootstrap replicates.
+  for (int b=0; b<nboot; ++b) {
+    int w = poisson(generator);
+    if (w==0) continue;
+    bootstrap_weight[b] += w;
+    for (int i=0; i<ns; ++i) bootstrap[b*ns+i].add(tilts[i]*J, w);
+  }
+  ++trials;
+}
+
+void LargeDeviationEstimator::addTrials(const map<int, int>& counts) {
+  const int ns = tilts.size();
+  for (auto cn : counts) {
+    int J = cn.first, n = cn.second;
+    for (int i=0; i<ns; ++i) accumulators[i].add(tilts[i]*J, n);
+    // The sum of n Poisson(1) weights is a Poisson(n) weight.
+    std::poisson_distribution<int> weight(n);
+    for (int b=0; b<nboot; ++b) {
+      int w = weight(generator);
+      if (w==0) continue;
+      bootstrap_weight[b] += w;
+      for (int i=0; i<ns; ++i) bootstrap[b*ns+i].add(tilts[i]*J, w);
+    }
+    trials += n;
+  }
+}
+
+double LargeDeviationEstimator::getSCGF(int i) const {
+  if (trials==0) return 0.;
+  return (accumulators[i].value() - log(static_cast<double>(trials)))/time;
+}
+
+double LargeDeviationEstimator::getSCGFError(int i) const {
+  const int ns = tilts.size();
+  // Mean and variance of the SCGF over the replicates.
+  double sum = 0., sumsqr = 0.;
+  int count = 0;
+  for (int b=0; b<nboot; ++b) {
+    if (bootstrap_weight[b]==0) continue;
+    double lambda = (bootstrap[b*ns+i].value() - log(bootstrap_weight[b]))/time;
+    sum += lambda;
+    sumsqr += lambda*lambda;
+    ++count;
+  }
+  if (count<2) return 0.;
+  double mean = sum/count;
+  double var = (sumsqr - count*mean*mean)/(count-1);
+  return var>0 ? sqrt(var) : 0.;
+}
+
+bool LargeDeviationEstimator::writeSCGF(const string fileName) const {
+  std::ofstream fout(fileName);
+  if (fout.fail()) {
+    cout << "Error occurred in opening \"" + fileName + "\".\n";
+    return false;
+  }
+  else {
+    // Print out parameters.
+    fout << time << "," << trials << endl;
+    // Print out the SCGF.
+    for (int i=0; i<getNTilts(); ++i)
+      fout << tilts[i] << "," << getSCGF(i) << "," << getSCGFError(i) << "\n";
+    fout.close();
+    // Return success.
+    return true;
+  }
+}
+
+bool LargeDeviationEstimator::writeRateFunction(const string fileName) const {
+  std::ofstream fout(fileName);
+  if (fout.fail()) {
+    cout << "Error occurred in opening \"" + fileName + "\".\n";
+    return false;
+  }
+  else {
+    const int ns = tilts.size();
+    // Print out parameters.
+    fout << time << "," << trials << endl;
+    // Parametric Legendre transform: j(s) = lambda'(s), I(j(s)) = s*j(s) - lambda(s). This avoids searching for the
+    // supremum over s, which is unstable where lambda is poorly estimated.
+    if (ns>1) {
+      for (int i=0; i<ns; ++i) {
+        int lo = i>0 ? i-1 : i, hi = i<ns-1 ? i+1 : i;
+        double j = (getSCGF(hi) - getSCGF(lo))/(tilts[hi] - tilts[lo]);
+        fout << j << "," << tilts[i]*j - getSCGF(i) << "\n";
+      }
+    }
+    fout.close();
+    // Return success.
+    return true;
+  }
+}
@@ -0,0 +1,88 @@
+#ifndef __LARGE_DEVIATION_HPP__
+#define __LARGE_DEVIATION_HPP__
+
+#include "utility.hpp"
+
+//! \brief Streaming estimator for the scaled cumulant generating function (SCGF) of the integrated current, and
+//! its Legendre transform, the rate function.
+//!
+//! For every tilt s on a grid, a running log-sum-exp of s*J is kept, so lambda(s) = log(<exp(s*J)>)/time can be
+//! read off at any point without storing the trials. Error bars come from a Poisson bootstrap, where each replicate
+//! weights every trial by a Poisson(1) count, so it can also be done on the fly. The driver and bin/merge build it
+//! from the final histograms, see writeLargeDeviations, so a sharded job writes the same files as a single process.
+class LargeDeviationEstimator {
+public:
+  //! \brief Constructor, takes the run time, the range of tilts, the number of tilts, the number of bootstrap replicates,
+  //! and the seed of the bootstrap weights.
+  LargeDeviationEstimator(double, double=-1., double=1., int=41, int=20, unsigned=0);
+
+  //! \brief Add the integrated current of a single trial.
+  void addTrial(int);
+
+  //! \brief Add all the trials in a histogram of (integrated current value, number of occurences).
+  void addTrials(const map<int, int>&);
+
+  //! \brief Get the tilt s of a grid point.
+  double getTilt(int i) const { return tilts[i]; }
+
+  //! \brief Get the number of grid points.
+  int getNTilts() const { return tilts.size(); }
+
+  //! \brief Get the number of trials that have been added.
+  int getTrials() const { return trials; }
+
+  //! \brief Get the SCGF at a grid point.
+  double getSCGF(int) const;
+
+  //! \brief Get the bootstrap standard error of the SCGF at a grid point.
+  double getSCGFError(int) const;
+
+  //! \brief Write (s, lambda(s), error) to a file.
+  bool writeSCGF(const string) const;
+
+  //! \brief Write (j, I(j)) to a file, where I is the Legendre transform of the SCGF.
+  bool writeRateFunction(const string) const;
+
+private:
+  //! \brief Accumulates log(sum_i w_i exp(x_i)) without overflowing.
+  struct LogSumExp {
+    double max = -std::numeric_limits<double>::infinity();
+    double sum = 0.;
+
+    inline void add(double x, double w=1.) {
+      if (x>max) {
+        sum = sum*exp(max-x) + w;
+        max = x;
+      }
+      else sum += w*exp(x-max);
+    }
+
+    inline double value() const { return max + log(sum); }
+  };
+
+  //! \brief The length of time each trial was run for.
+  double time;
+
+  //! \brief The grid of tilts.
+  vector<double> tilts;
+
+  //! \brief The number of trials that have been added.
+  int trials = 0;
+
+  //! \brief Log-sum-exp accumulators, one per tilt.
+  vector<LogSumExp> accumulators;
+
+  //! \brief The number of bootstrap replicates.
+  int nboot;
+
+  //! \brief Log-sum-exp accumulators, one per (replicate, tilt).
+  vector<LogSumExp> bootstrap;
+
+  //! \brief The total weight given to the trials by each replicate.
+  vector<double> bootstrap_weight;
+
+  std::default_random_engine generator;
+  std::poisson_distribution<int> poisson;
+};
+
+#endif // __LARGE_DEVIATION_HPP__
@@ -0,0 +1,90 @@
+#include "shard.hpp"
+#include "large-deviation.hpp"
+
+// Combine the shard files written by "driver -shard=k/N" into the files a single process run would have written.
+// Takes the same -directory, -numsys and tilt arguments as the driver, and the number of shards as -shards=N.
+
+//! \brief Read and merge the N shard files of a run. Returns false if any are missing, if they are not the shards of a
+//! single job, or if the blocks do not line up.
+bool mergeShards(const string base, int count, ShardData& data) {
+  for (int k=0; k<count; ++k) {
+    Shard shard, recorded;
+    shard.index = k;
+    shard.count = count;
+    ShardData part;
+    if (!readShard(shardFileName(base, shard), part, recorded)) return false;
+    if (recorded.index!=shard.index || recorded.count!=shard.count) {
+      cout << "Shard file " << k << " of [" << base << "] records itself as shard " << recorded.index << "/" << recorded.count << ".\n";
+      return false;
+    }
+    // The first shard sets the parameters of the job, the others must agree with it.
+    if (k==0) {
+      data = part;
+      continue;
+    }
+    if (!data.sameJob(part)) {
+      cout << "Shard " << k << " of [" << base << "] is from a different job (seed, time, trials or occupation size differ).\n";
+      return false;
+    }
+    if (!data.merge(part)) {
+      cout << "Shards of [" << base << "] overlap.\n";
+      return false;
+    }
+  }
+  if (data.getBlocks()!=numberOfBlocks(data.trials)) {
+    cout << "Shards of [" << base << "] are missing " << numberOfBlocks(data.trials) - data.getBlocks() << " blocks.\n";
+    return false;
+  }
+  return true;
+}
+
+//! \brief Write the total occupation of merged data, if it was recorded.
+void writeOccupation(const string fileName, const ShardData& data) {
+  if (data.occ_size==0) return;
+  vector<double> occ = data.totalOccupation();
+  vector<double*> rows(data.occ_size);
+  for (int i=0; i<data.occ_size; ++i) rows[i] = &occ[i*data.occ_size];
+  writeToFile(fileName, rows.data(), data.occ_size);
+}
+
+int main(int argc, char **argv) {
+  int shards = 1;
+  int numsys = 20;
+  double smin = -1., smax = 1.;
+  int ns = 41, nboot = 20;
+  string directory = "demon";
+
+  // Get command line arguments.
+  ArgParse parser(argc, argv);
+  parser.get("shards", shards);
+  parser.get("numsys", numsys);
+  parser.get("smin", smin);
+  parser.get("smax", smax);
+  parser.get("ns", ns);
+  parser.get("nboot", nboot);
+  parser.get("directory", directory);
+
+  int failures = 0;
+  for (int I=0; I<numsys; ++I) {
+    string dir = directory + "/" + directory + "-" + toString(I) + "/";
+    ShardData data1, data2;
+    if (!mergeShards(dir+"data1", shards, data1) || !mergeShards(dir+"data2", shards, data2)) {
+      ++failures;
+      continue;
+    }
+    // Write data to files, exactly as the driver does.
+    double time = data1.time;
+    int trials = data1.trials;
+    double entropy = data2.totalEntropy()/trials;
+    writeToFile(dir+"data1.csv", data1.counts, time, trials, data1.affinity, entropy);
+    writeToFile(dir+"data2.csv", data2.counts, time, trials, data2.affinity, entropy);
+    writeLargeDeviations(dir, data1, data2, smin, smax, ns, nboot);
+    // Occupation, if the shards recorded it.
+    writeOccupation(dir+"data1-occ.csv", data1);
+    writeOccupation(dir+"data2-occ.csv", data2);
+
+    cout << "Merged run " << I << ".\n";
+  }
+
+  return failures==0 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+#ifndef __OBSERVERS_HPP__
+#define __OBSERVERS_HPP__
+
+#include "utility.hpp"
+
+// Observers are compile-time policies for the simulation kernels (CurrentSystem::runCurrent and
+// LargeCurrentSystem::runSystem). A kernel calls two hooks on its observer:
+//
+//   dwell(state..., dt)  - the system sat in a state for a time dt.
+//       CurrentSystem:      dwell(int nl, int nr, double dt)
+//       LargeCurrentSystem: dwell(const int* occupation, int nstates, double dt)
+//   transition(...)      - a transition was enacted.
+//       CurrentSystem:      transition(int type)
+//       LargeCurrentSystem: transition(int site, int dir, double demon_rate)
+//
+// Observers derive from NullObserver and override only the hooks they need, the rest are empty inline templates
+// that compile away. Several observers can be combined with observe(a, b, ...).
+
+//! \brief Observer that records nothing.
+struct NullObserver {
+  template<typename... Args> inline void dwell(const Args&...) {}
+  template<typename... Args> inline void transition(const Args&...) {}
+};
+
+//! \brief Records the time a CurrentSystem spends in each (nl, nr) state, up to some maximum occupation.
+class OccupationObserver : public NullObserver {
+public:
+  OccupationObserver(double **occ, int size) : occupation(occ), occ_size(size) {};
+
+  inline void dwell(int nl, int nr, double dt) {
+    if (nl<occ_size && nr<occ_size) occupation[nl][nr] += dt;
+  }
+
+private:
+  double **occupation;
+  int occ_size;
+};
+
+//! \brief Counts the number of times each transition type of a CurrentSystem occurs.
+class ChannelObserver : public NullObserver {
+public:
+  //! \brief The number of transition types of a CurrentSystem.
+  static const int nchannels = 6;
+
+  inline void transition(int type) { ++counts[type]; }
+
+  int getCount(int type) const { return counts[type]; }
+
+private:
+  int counts[nchannels] = {0, 0, 0, 0, 0, 0};
+};
+
+//! \brief Counts the total number of transitions (the activity) and the time they took.
+class ActivityObserver : public NullObserver {
+public:
+  template<typename... Args> inline void dwell(const Args&... args) { time += last(args...); }
+  template<typename... Args> inline void transition(const Args&...) { ++activity; }
+
+  long getActivity() const { return activity; }
+  double getTime() const { return time; }
+
+private:
+  // The time step is always the last argument of dwell.
+  template<typename T> static inline double last(const T& t) { return t; }
+  template<typename T, typename... Args> static inline double last(const T&, const Args&... args) { return last(args...); }
+
+  long activity = 0;
+  double time = 0.;
+};
+
+//! \brief Accumulates the demon entropy of a LargeCurrentSystem, dir*log(rate/last rate) for each transition.
+class EntropyObserver : public NullObserver {
+public:
+  inline void transition(int, int dir, double demon_rate) {
+    entropy += dir*log(demon_rate/last_demon_rate);
+    last_demon_rate = demon_rate;
+  }
+
+  double getEntropy() const { return entropy; }
+
+private:
+  double entropy = 0.;
+  double last_demon_rate = 1.;
+};
+
+//! \brief Forwards each hook to a list of observers, held by reference.
+template<typename... Observers> class ObserverList;
+
+template<> class ObserverList<> : public NullObserver {};
+
+template<typename First, typename... Rest> class ObserverList<First, Rest...> {
+public:
+  ObserverList(First& f, Rest&... r) : first(f), rest(r...) {};
+
+  template<typename... Args> inline void dwell(const Args&... args) {
+    first.dwell(args...);
+    rest.dwell(args...);
+  }
+
+  template<typename... Args> inline void transition(const Args&... args) {
+    first.transition(args...);
+    rest.transition(args...);
+  }
+
+private:
+  First &first;
+  ObserverList<Rest...> rest;
+};
+
+//! \brief Combine several observers into one.
+template<typename... Observers> inline ObserverList<Observers...> observe(Observers&... observers) {
+  return ObserverList<Observers...>(observers...);
+}
+
+#endif // __OBSERVERS_HPP__
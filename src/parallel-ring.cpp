@@ -0,0 +1,282 @@
+#include "parallel-ring.hpp"
+
+namespace {
+  //! \brief Blocks threads until all of them have arrived. Windows are short, so waiting threads spin (yielding after a
+  //! while, in case there are more threads than cores) rather than sleep.
+  class Barrier {
+  public:
+    Barrier(int n) : count(n), waiting(0), generation(0) {};
+
+    void wait() {
+      int gen = generation.load(std::memory_order_acquire);
+      if (waiting.fetch_add(1, std::memory_order_acq_rel)==count-1) {
+        waiting.store(0, std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+      }
+      else
+        for (int spins=0; generation.load(std::memory_order_acquire)==gen; ++spins)
+          if (spins>=spin_limit) std::this_thread::yield();
+    }
+
+  private:
+    static const int spin_limit = 1000;
+    const int count;
+    std::atomic<int> waiting, generation;
+  };
+
+  //! \brief A binary sum tree over the exit rates of the sites of a segment, for selecting events in O(log L).
+  class RateTree {
+  public:
+    RateTree(int n=1) {
+      size = 1;
+      while (size<n) size <<= 1;
+      tree = vector<double>(2*size, 0.);
+    }
+
+    inline void set(int i, double rate) {
+      i += size;
+      tree[i] = rate;
+      for (i >>= 1; i>0; i >>= 1) tree[i] = tree[2*i] + tree[2*i+1];
+    }
+
+    inline double get(int i) const { return tree[i+size]; }
+
+    inline double total() const { return tree[1]; }
+
+    //! \brief The leaf whose cumulative range contains x, where 0 <= x < total().
+    inline int find(double x) const {
+      int i = 1;
+      while (i<size) {
+        if (x<tree[2*i]) i = 2*i;
+        else {
+          x -= tree[2*i];
+          i = 2*i+1;
+        }
+      }
+      return i-size;
+    }
+
+  private:
+    int size;
+    vector<double> tree;
+  };
+}
+
+//! \brief The state a thread keeps for its segment, across trials.
+struct RingSegment {
+  //! \brief The sites [first, last) of the ring.
+  int first, last;
+
+  //! \brief Forward and backward hop rates of each site, counting only the segment's interior links.
+  vector<double> forward, backward;
+  RateTree tree;
+
+  //! \brief The segment's own copy of the demon functions, which it grows as needed.
+  DemonTable demons;
+
+  RandomEngine generator;
+
+  //! \brief The current, reference current and (integrated) demon entropy production of the segment in each trial.
+  vector<int> J, J_reference;
+  vector<double> entropy;
+};
+
+ParallelRingSystem::ParallelRingSystem(int s, int p, int n, double kp, double km)
+  : nsites(s), nparticles(p), demons(1, 8), seed(time(0)) {
+  Kpos = vector<double>(nsites, kp);
+  Kneg = vector<double>(nsites, km);
+  // Spread the particles evenly.
+  occupation = vector<int>(nsites, 0);
+  for (int i=0; i<nparticles; ++i) ++occupation[static_cast<long>(i)*nsites/nparticles];
+  initialize(n);
+}
+
+ParallelRingSystem::ParallelRingSystem(const LargeCurrentSystem& system, int n)
+  : nsites(system.getNStates()), nparticles(system.getNParticles()), demons(system.getDemonFunctions()), shared_demon(false), seed(time(0)) {
+  Kpos = vector<double>(nsites);
+  Kneg = vector<double>(nsites);
+  occupation = vector<int>(nsites);
+  for (int i=0; i<nsites; ++i) {
+    Kpos[i] = system.getKpos(i);
+    Kneg[i] = system.getKneg(i);
+    occupation[i] = system.getInitialOccupation(i);
+  }
+  initialize(n);
+}
+
+void ParallelRingSystem::initialize(int n) {
+  initial_occupation = occupation;
+  // Boundary links of neighbouring segments must not share a site, so segments need at least two sites.
+  nsegments = std::max(1, std::min(n, nsites/2));
+  bounds = vector<int>(nsegments+1);
+  for (int s=0; s<=nsegments; ++s) bounds[s] = static_cast<long>(s)*nsites/nsegments;
+}
+
+void ParallelRingSystem::setDemonRule(std::function<double(int, int)> rule) {
+  demons = DemonTable(1, 8);
+  demons.setRule([=](int, int nl, int nr) { return rule(nl, nr); });
+  shared_demon = true;
+}
+
+RingResult ParallelRingSystem::runSystem(double runtime) {
+  vector<RingSegment> segments;
+  run(1, runtime, false, segments);
+  RingResult result;
+  for (auto& seg : segments) {
+    result.J += seg.J[0];
+    result.J_reference += seg.J_reference[0];
+    result.entropy.push_back(seg.entropy[0]/runtime);
+  }
+  return result;
+}
+
+RingStatistics ParallelRingSystem::gatherCurrentStatistics(int trials, double time) {
+  vector<RingSegment> segments;
+  run(trials, time, true, segments);
+  RingStatistics statistics;
+  statistics.entropy = vector<double>(nsegments, 0.);
+  for (int i=0; i<trials; ++i) {
+    int J = 0, J_reference = 0;
+    for (int s=0; s<nsegments; ++s) {
+      J += segments[s].J[i];
+      J_reference += segments[s].J_reference[i];
+      statistics.entropy[s] += segments[s].entropy[i]/time;
+    }
+    ++statistics.counts[J];
+    ++statistics.reference_counts[J_reference];
+  }
+  for (auto& e : statistics.entropy) e /= trials;
+  return statistics;
+}
+
+void ParallelRingSystem::run(int trials, double runtime, bool blocks, vector<RingSegment>& segments) {
+  int *occ = occupation.data();
+  const int *initial = initial_occupation.data();
+  const double *kpos = Kpos.data(), *kneg = Kneg.data();
+  const bool shared = shared_demon;
+  const int reference_link = ((reference % nsites) + nsites) % nsites;
+  const int nwindows = std::max(1, static_cast<int>(ceil(runtime/window)));
+  // Trial i runs on substream runs+i.
+  const unsigned first_run = runs;
+  runs += trials;
+
+  segments = vector<RingSegment>(nsegments);
+  Barrier barrier(nsegments);
+
+  auto simulate = [&](int s) {
+    RingSegment& seg = segments[s];
+    seg.first = bounds[s];
+    seg.last = bounds[s+1];
+    const int length = seg.last - seg.first;
+    seg.forward = vector<double>(length, 0.);
+    seg.backward = vector<double>(length, 0.);
+    seg.tree = RateTree(length);
+    seg.demons = demons;
+    seg.J = vector<int>(trials, 0);
+    seg.J_reference = vector<int>(trials, 0);
+    seg.entropy = vector<double>(trials, 0.);
+    std::exponential_distribution<double> exponential;
+    std::uniform_real_distribution<double> uniform;
+
+    // The demon function of link i (from site i to site i+1).
+    auto demon = [&](int i, int nl, int nr) { return seg.demons(shared ? 0 : i, nl, nr); };
+    // Recompute the interior hop rates of a site.
+    auto update = [&](int i) {
+      if (i<seg.first || seg.last<=i) return;
+      int k = i - seg.first, n = occ[i];
+      seg.forward[k] = (n>0 && i+1<seg.last) ? n*kpos[i]*demon(i, n, occ[i+1]) : 0.;
+      seg.backward[k] = (n>0 && seg.first<i) ? n*kneg[i-1]*demon(i-1, occ[i-1], n) : 0.;
+      seg.tree.set(k, seg.forward[k] + seg.backward[k]);
+    };
+    // Recompute every rate. Only reads the segment's own sites, so segments can do this at the same time.
+    auto rebuild = [&]() {
+      int largest = 0;
+      for (int i=seg.first; i<seg.last; ++i) largest = std::max(largest, occ[i]);
+      seg.demons.reserve(largest);
+      for (int i=seg.first; i<seg.last; ++i) update(i);
+    };
+
+    // The boundary link, from the last site of this segment to the first site of the next.
+    const int left = seg.last-1, right = seg.last % nsites;
+
+    rebuild();
+    for (int trial=0; trial<trials; ++trial) {
+      // Start each block from the initial particle positions. Each segment resets its own sites.
+      if (blocks && trial % shard_block_size==0) {
+        std::copy(initial+seg.first, initial+seg.last, occ+seg.first);
+        rebuild();
+      }
+      seg.generator.seed(substreamSeed(substreamSeed(seed, first_run+trial), s));
+      int &J = seg.J[trial], &J_reference = seg.J_reference[trial];
+      double &entropy = seg.entropy[trial], last_demon_rate = 1.;
+      auto record = [&](int link, int dir, double demon_rate) {
+        J += dir;
+        if (link==reference_link) J_reference += dir;
+        entropy += dir*log(demon_rate/last_demon_rate);
+        last_demon_rate = demon_rate;
+      };
+
+      double elapsed = 0;
+      for (int w=0; w<nwindows; ++w) {
+        const double tau = std::min(window, runtime - elapsed);
+        elapsed += tau;
+
+        // Phase 1: hops on interior links.
+        for (double t=exponential(seg.generator)/seg.tree.total(); t<tau; t+=exponential(seg.generator)/seg.tree.total()) {
+          double x = uniform(seg.generator)*seg.tree.total();
+          int k = seg.tree.find(x);
+          // Round off can land on a site with no rate.
+          if (seg.tree.get(k)<=0) continue;
+          int i = seg.first + k, dir, j;
+          if (uniform(seg.generator)*(seg.forward[k] + seg.backward[k]) < seg.forward[k]) {
+            dir = 1;
+            j = i+1;
+          }
+          else {
+            dir = -1;
+            j = i-1;
+          }
+          int link = dir==1 ? i : j;
+          double demon_rate = dir==1 ? demon(i, occ[i], occ[j]) : demon(j, occ[j], occ[i]);
+          --occ[i];
+          ++occ[j];
+          seg.demons.reserve(occ[j]);
+          record(link, dir, demon_rate);
+          for (int m=std::min(i, j)-1; m<=std::max(i, j)+1; ++m) update(m);
+        }
+        barrier.wait();
+
+        // Phase 2: hops on the boundary link. The next segment's phase 1 may have grown its first site past this
+        // segment's table.
+        seg.demons.reserve(occ[right]);
+        for (double t=0; ; ) {
+          int nl = occ[left], nr = occ[right];
+          double demon_rate = demon(left, nl, nr);
+          double fwd = nl*kpos[left]*demon_rate, bwd = nr*kneg[left]*demon_rate;
+          if (fwd+bwd<=0) break;
+          t += exponential(seg.generator)/(fwd+bwd);
+          if (t>=tau) break;
+          int dir = uniform(seg.generator)*(fwd+bwd) < fwd ? 1 : -1;
+          occ[left] -= dir;
+          occ[right] += dir;
+          seg.demons.reserve(std::max(occ[left], occ[right]));
+          record(left, dir, demon_rate);
+        }
+        barrier.wait();
+
+        // The neighbours' boundary hops may have changed the sites at both ends of the segment.
+        seg.demons.reserve(occ[seg.first]);
+        update(seg.first);
+        update(seg.first+1);
+        update(seg.last-2);
+        update(seg.last-1);
+      }
+    }
+  };
+
+  // One worker per segment, for all the trials.
+  vector<std::thread> threads;
+  for (int s=1; s<nsegments; ++s) threads.push_back(std::thread(simulate, s));
+  simulate(0);
+  for (auto& t : threads) t.join();
+}
@@ -0,0 +1,101 @@
+#ifndef __PARALLEL_RING_HPP__
+#define __PARALLEL_RING_HPP__
+
+#include "large-current.hpp"
+
+struct RingSegment;
+
+//! \brief The result of a single run of a ParallelRingSystem.
+struct RingResult {
+  //! \brief The integrated current summed over all links, as LargeCurrentSystem::runSystem counts it.
+  int J = 0;
+
+  //! \brief The integrated current across the reference link.
+  int J_reference = 0;
+
+  //! \brief The demon entropy production (per unit time) of each segment. Like EntropyObserver, each event adds
+  //! dir*log(demon_rate/last_demon_rate), but last_demon_rate is that of the previous event of the same segment, as
+  //! events in different segments are not ordered. So the sum over segments is not the quantity LargeCurrentSystem
+  //! records, and they can differ by a few percent (-ring_check prints both).
+  vector<double> entropy;
+};
+
+//! \brief Statistics of many runs of a ParallelRingSystem.
+struct RingStatistics {
+  //! \brief Histograms of (integrated current value, number of occurences), for the total and reference currents.
+  map<int, int> counts, reference_counts;
+
+  //! \brief The mean demon entropy production of each segment, see RingResult.
+  vector<double> entropy;
+};
+
+//! \brief Runs the LargeCurrentSystem dynamics on a long ring, split into segments that are simulated by separate
+//! threads.
+//!
+//! Time advances in windows. In each window, every segment first runs the hops on its interior links for the length
+//! of the window (segments share no sites, so this needs no communication), and then every segment runs the hops on
+//! the link from its last site to the next segment's first site (these links share no sites either, as segments have
+//! at least two sites). This is a synchronous sublattice (Lie-Trotter) splitting of the generator, exact as the window
+//! goes to zero. Within a phase, events are selected with a sum tree, so each event costs O(log L) for a segment of L
+//! sites.
+class ParallelRingSystem {
+public:
+  //! \brief Constructor for a homogeneous ring. Takes the number of sites, particles and segments, and the forward
+  //! and backward rates. Particles are spread evenly.
+  ParallelRingSystem(int, int, int, double=1., double=1.);
+
+  //! \brief Constructor that copies the rates, demon functions and initial particle positions of a LargeCurrentSystem.
+  ParallelRingSystem(const LargeCurrentSystem&, int);
+
+  //! \brief Run the ring for some amount of time, starting from the current particle positions.
+  RingResult runSystem(double);
+
+  //! \brief Run many trials. As in LargeCurrentSystem, trials run in blocks that start from the initial positions.
+  //! The segments keep their threads and state across all the trials.
+  RingStatistics gatherCurrentStatistics(int, double);
+
+  //! \brief Use the same demon function, a rule of (nl, nr), on every link.
+  void setDemonRule(std::function<double(int, int)>);
+
+  //! \brief Set the length of a time window.
+  void setWindow(double w) { window = w; }
+
+  //! \brief Set the link (from site i to site i+1) whose current is recorded as the reference current.
+  void setReferenceLink(int i) { reference = i; }
+
+  //! \brief Set the seed that the random substreams of the segments are derived from.
+  void setSeed(unsigned s) { seed = s; runs = 0; }
+
+  int getNSegments() const { return nsegments; }
+
+private:
+  //! \brief Set the segments up, once the sites are known.
+  void initialize(int);
+
+  //! \brief Run trials, one worker thread per segment, each recording its share of the results of every trial. If
+  //! blocks is true, each block of trials starts from the initial positions.
+  void run(int, double, bool, vector<RingSegment>&);
+
+  int nsites, nparticles, nsegments;
+
+  //! \brief Forward and backward rates of each link.
+  vector<double> Kpos, Kneg;
+
+  //! \brief Demon functions, either one shared by every link, or one per link.
+  DemonTable demons;
+  bool shared_demon = true;
+
+  //! \brief Site occupation, and where each block of trials starts from.
+  vector<int> occupation, initial_occupation;
+
+  //! \brief The first site of each segment, and one past the last site of the last segment.
+  vector<int> bounds;
+
+  double window = 0.05;
+  int reference = 0;
+
+  unsigned seed;
+  unsigned runs = 0;
+};
+
+#endif // __PARALLEL_RING_HPP__
@@ -0,0 +1,137 @@
+#include "shard.hpp"
+// For setprecision
+#include <iomanip>
+
+bool Shard::parse(const string& str) {
+  // Find the separator.
+  auto pos = str.find('/');
+  if (pos==string::npos) return false;
+  int k = -1, N = 0;
+  stringstream first(str.substr(0, pos)), second(str.substr(pos+1));
+  first >> k;
+  second >> N;
+  if (first.fail() || second.fail() || N<1 || k<0 || N<=k) return false;
+  index = k;
+  count = N;
+  return true;
+}
+
+bool ShardData::merge(const ShardData& data) {
+  // Shards of different jobs (another seed, say) cannot be combined.
+  if (!sameJob(data)) return false;
+  // Check that no block is gathered twice.
+  for (auto &e : data.entropy)
+    if (entropy.find(e.first)!=entropy.end()) return false;
+  for (auto &o : data.occupation)
+    if (occupation.find(o.first)!=occupation.end()) return false;
+  // Add histograms.
+  for (auto cn : data.counts) counts[cn.first] += cn.second;
+  // Collect blocks.
+  entropy.insert(data.entropy.begin(), data.entropy.end());
+  occupation.insert(data.occupation.begin(), data.occupation.end());
+  return true;
+}
+
+bool ShardData::sameJob(const ShardData& data) const {
+  return seed==data.seed && time==data.time && trials==data.trials && occ_size==data.occ_size;
+}
+
+double ShardData::totalEntropy() const {
+  double total = 0;
+  for (auto &e : entropy) total += e.second;
+  return total;
+}
+
+vector<double> ShardData::totalOccupation() const {
+  vector<double> total(occ_size*occ_size, 0.);
+  for (auto &o : occupation)
+    for (int i=0; i<occ_size*occ_size; ++i) total[i] += o.second[i];
+  return total;
+}
+
+bool writeShard(const string fileName, const ShardData& data, const Shard& shard) {
+  std::ofstream fout(fileName);
+  if (fout.fail()) {
+    cout << "Error occurred in opening \"" + fileName + "\".\n";
+    return false;
+  }
+  else {
+    // Print enough digits that doubles are read back exactly.
+    fout << std::setprecision(17);
+    // Print out parameters.
+    fout << shard.index << "," << shard.count << "," << data.time << "," << data.trials << "," << data.affinity << "," << data.occ_size << "," << data.seed << endl;
+    // Print out distribution.
+    fout << "counts," << data.counts.size() << "\n";
+    for (auto cn : data.counts) fout << cn.first << "," << cn.second << "\n";
+    // Print out entropy.
+    fout << "entropy," << data.entropy.size() << "\n";
+    for (auto &e : data.entropy) fout << e.first << "," << e.second << "\n";
+    // Print out occupation.
+    fout << "occupation," << data.occupation.size() << "\n";
+    for (auto &o : data.occupation) {
+      fout << o.first;
+      for (auto v : o.second) fout << "," << v;
+      fout << "\n";
+    }
+    fout.close();
+    // Return success.
+    return true;
+  }
+}
+
+bool readShard(const string fileName, ShardData& data, Shard& shard) {
+  std::ifstream fin(fileName);
+  if (fin.fail()) {
+    cout << "Error occurred in opening \"" + fileName + "\".\n";
+    return false;
+  }
+  char comma;
+  string section;
+  int n;
+  // Read parameters.
+  fin >> shard.index >> comma >> shard.count >> comma >> data.time >> comma >> data.trials >> comma >> data.affinity >> comma >> data.occ_size >> comma >> data.seed;
+  // Read distribution.
+  std::getline(fin >> std::ws, section, ',');
+  fin >> n;
+  for (int i=0; i<n; ++i) {
+    int J, c;
+    fin >> J >> comma >> c;
+    data.counts[J] += c;
+  }
+  // Read entropy.
+  std::getline(fin >> std::ws, section, ',');
+  fin >> n;
+  for (int i=0; i<n; ++i) {
+    int block;
+    double e;
+    fin >> block >> comma >> e;
+    data.entropy[block] = e;
+  }
+  // Read occupation.
+  std::getline(fin >> std::ws, section, ',');
+  fin >> n;
+  for (int i=0; i<n; ++i) {
+    int block;
+    vector<double> occ(data.occ_size*data.occ_size);
+    fin >> block;
+    for (auto &v : occ) fin >> comma >> v;
+    data.occupation[block] = occ;
+  }
+  if (fin.fail()) {
+    cout << "Error occurred in reading \"" + fileName + "\".\n";
+    return false;
+  }
+  return true;
+}
+
+void writeLargeDeviations(const string dir, const ShardData& data1, const ShardData& data2, double smin, double smax, int ns, int nboot) {
+  // Each estimator gets its own bootstrap substream of the system's seed.
+  LargeDeviationEstimator ldf1(data1.time, smin, smax, ns, nboot, substreamSeed(data1.seed, 1));
+  LargeDeviationEstimator ldf2(data2.time, smin, smax, ns, nboot, substreamSeed(data2.seed, 2));
+  ldf1.addTrials(data1.counts);
+  ldf2.addTrials(data2.counts);
+  ldf1.writeSCGF(dir+"scgf1.csv");
+  ldf1.writeRateFunction(dir+"rate1.csv");
+  ldf2.writeSCGF(dir+"scgf2.csv");
+  ldf2.writeRateFunction(dir+"rate2.csv");
+}
@@ -0,0 +1,84 @@
+#ifndef __SHARD_HPP__
+#define __SHARD_HPP__
+
+#include "utility.hpp"
+#include "large-deviation.hpp"
+
+//! \brief The number of trials in a block. Blocks are the unit of work that is divided between shards, and each block
+//! runs on its own random substream, so the result does not depend on how the blocks are divided.
+const int shard_block_size = 1000;
+
+//! \brief The number of blocks needed for some number of trials.
+inline int numberOfBlocks(int trials) {
+  return (trials + shard_block_size - 1)/shard_block_size;
+}
+
+//! \brief Shard k of N runs the k-th contiguous range of blocks. The default is a single shard that runs everything.
+struct Shard {
+  int index = 0, count = 1;
+
+  //! \brief Parse a shard given as "k/N". Returns false (and leaves the shard unchanged) if the string is malformed.
+  bool parse(const string&);
+
+  //! \brief The first block this shard runs.
+  int firstBlock(int nblocks) const { return (index*nblocks)/count; }
+
+  //! \brief One past the last block this shard runs.
+  int lastBlock(int nblocks) const { return ((index+1)*nblocks)/count; }
+};
+
+//! \brief The statistics gathered by one shard. Floating point data is kept per block, and only summed (in block order)
+//! once all the shards are merged, so a merged result is identical to a single process run.
+struct ShardData {
+  //! \brief Histogram of (integrated current value, number of occurences).
+  map<int, int> counts;
+
+  //! \brief Entropy production summed over the trials of each block, keyed by block. Every gathered block has an entry.
+  map<int, double> entropy;
+
+  //! \brief Occupation of each block, an occ_size x occ_size row major array, keyed by block.
+  map<int, vector<double> > occupation;
+  int occ_size = 0;
+
+  //! \brief Parameters of the run.
+  double time = 0;
+  int trials = 0;
+  double affinity = 0;
+
+  //! \brief The seed of the system that gathered the data, which the bootstrap substreams of its estimators derive from.
+  unsigned seed = 0;
+
+  //! \brief Add the data of another shard of the same job. Returns false if the shards overlap or belong to different
+  //! jobs, see sameJob.
+  bool merge(const ShardData&);
+
+  //! \brief Whether another shard was gathered by the same job: the same seed, time, number of trials and occupation size.
+  bool sameJob(const ShardData&) const;
+
+  //! \brief The number of blocks that have been gathered.
+  int getBlocks() const { return entropy.size(); }
+
+  //! \brief The total entropy production, summed in block order.
+  double totalEntropy() const;
+
+  //! \brief The total occupation, summed in block order.
+  vector<double> totalOccupation() const;
+};
+
+//! \brief Write the data of a shard to a file, at full precision.
+bool writeShard(const string, const ShardData&, const Shard&);
+
+//! \brief Read the data of a shard from a file, and which shard of the job it is.
+bool readShard(const string, ShardData&, Shard&);
+
+//! \brief Write the SCGF and rate function files (scgf1, rate1, scgf2, rate2) of the two sets of trials of a system to
+//! a directory. They are built from the final histograms, so a merged run writes exactly what a single process writes.
+//! Takes the range of tilts, the number of tilts, and the number of bootstrap replicates.
+void writeLargeDeviations(const string, const ShardData&, const ShardData&, double, double, int, int);
+
+//! \brief The name of the file that shard k of N writes for a file that would otherwise be called base.csv.
+inline string shardFileName(const string base, const Shard& shard) {
+  return base + ".shard-" + toString(shard.index) + "-of-" + toString(shard.count) + ".csv";
+}
+
+#endif // __SHARD_HPP__
@@ -0,0 +1,75 @@
+#include "telemetry.hpp"
+
+Telemetry::Telemetry(const string file, double i) : fileName(file), interval(i) {
+  // Measure the cost of a random draw, the same way the kernels draw them.
+  RandomEngine generator;
+  std::exponential_distribution<float> distribution(1.0);
+  const int ndraws = 1000000;
+  float sum = 0;
+  auto begin = high_resolution_clock::now();
+  for (int i=0; i<ndraws; ++i) sum += distribution(generator);
+  auto end = high_resolution_clock::now();
+  draw_cost = duration_cast<duration<double> >(end-begin).count()/ndraws;
+  // Keep the loop from being optimized away.
+  if (sum<0) cout << sum;
+
+  start = last_report = high_resolution_clock::now();
+}
+
+void Telemetry::add(const TelemetryObserver& observer) {
+  std::lock_guard<std::mutex> guard(lock);
+  for (int i=0; i<TelemetryObserver::ntypes; ++i) totals.events[i] += observer.events[i];
+  totals.draws += observer.draws;
+  totals.sim_time += observer.sim_time;
+  totals.trials += observer.trials;
+  totals.trial_wall += observer.trial_wall;
+  if (observer.trial_wall_max>totals.trial_wall_max) totals.trial_wall_max = observer.trial_wall_max;
+}
+
+void Telemetry::addIO(double t) {
+  std::lock_guard<std::mutex> guard(lock);
+  io_time += t;
+}
+
+void Telemetry::report() {
+  std::lock_guard<std::mutex> guard(lock);
+  auto now = high_resolution_clock::now();
+  if (duration_cast<duration<double> >(now-last_report).count()<interval) return;
+  write();
+}
+
+void Telemetry::flush() {
+  std::lock_guard<std::mutex> guard(lock);
+  write();
+}
+
+void Telemetry::write() {
+  auto begin = high_resolution_clock::now();
+  std::ofstream fout(fileName, header ? std::ios::app : std::ios::out);
+  if (fout.fail()) {
+    cout << "Error occurred in opening \"" + fileName + "\".\n";
+    return;
+  }
+  if (!header) {
+    fout << "wall,trials,total_trials,trials_per_sec,events,events_per_sec,events_per_sim_time,mean_trial_wall,max_trial_wall,rng_time,selection_time,io_time,eta";
+    for (int i=0; i<TelemetryObserver::ntypes; ++i) fout << ",events_" << i;
+    fout << endl;
+    header = true;
+  }
+  double wall = duration_cast<duration<double> >(begin-start).count();
+  long events = 0;
+  for (int i=0; i<TelemetryObserver::ntypes; ++i) events += totals.events[i];
+  double trial_rate = wall>0 ? totals.trials/wall : 0.;
+  double rng_time = totals.draws*draw_cost;
+  double eta = trial_rate>0 && total_trials>totals.trials ? (total_trials-totals.trials)/trial_rate : 0.;
+  fout << wall << "," << totals.trials << "," << total_trials << "," << trial_rate << "," << events << ","
+       << (wall>0 ? events/wall : 0.) << "," << (totals.sim_time>0 ? events/totals.sim_time : 0.) << ","
+       << (totals.trials>0 ? totals.trial_wall/totals.trials : 0.) << "," << totals.trial_wall_max << ","
+       << rng_time << "," << std::max(0., totals.trial_wall - rng_time) << "," << io_time << "," << eta;
+  for (int i=0; i<TelemetryObserver::ntypes; ++i) fout << "," << totals.events[i];
+  fout << endl;
+  fout.close();
+  // Writing the report counts as I/O.
+  last_report = high_resolution_clock::now();
+  io_time += duration_cast<duration<double> >(last_report-begin).count();
+}
@@ -0,0 +1,88 @@
+#ifndef __TELEMETRY_HPP__
+#define __TELEMETRY_HPP__
+
+#include "observers.hpp"
+
+#include <mutex>
+
+//! \brief Observer that counts what a kernel does: events per transition type, simulated time, and random numbers
+//! drawn. Each thread runs its own, and hands it to a Telemetry object when it finishes a block of trials.
+class TelemetryObserver : public NullObserver {
+public:
+  //! \brief Transition types. CurrentSystem uses types 0-5, LargeCurrentSystem uses 0 (forward) and 1 (backward).
+  static const int ntypes = 6;
+
+  //! \brief CurrentSystem: two draws for the reservoirs, and two more for each occupied site.
+  inline void dwell(int nl, int nr, double dt) {
+    draws += 2 + (nl>0 ? 2 : 0) + (nr>0 ? 2 : 0);
+    sim_time += dt;
+  }
+
+  //! \brief LargeCurrentSystem: two draws for each occupied site.
+  inline void dwell(const int *occupation, int nstates, double dt) {
+    for (int i=0; i<nstates; ++i) draws += occupation[i]>0 ? 2 : 0;
+    sim_time += dt;
+  }
+
+  inline void transition(int type) { ++events[type]; }
+  inline void transition(int, int dir, double) { ++events[dir>0 ? 0 : 1]; }
+
+  //! \brief Record the wall time of a trial.
+  void addTrial(double wall) {
+    ++trials;
+    trial_wall += wall;
+    if (wall>trial_wall_max) trial_wall_max = wall;
+  }
+
+  long events[ntypes] = {0, 0, 0, 0, 0, 0};
+  long draws = 0;
+  double sim_time = 0.;
+  long trials = 0;
+  double trial_wall = 0., trial_wall_max = 0.;
+};
+
+//! \brief Collects the counters of all threads, and periodically writes throughput and an ETA to a file.
+//!
+//! Time spent drawing random numbers is not timed in the kernel, which would cost more than the draws themselves.
+//! Instead, the cost of a draw is measured once at construction and multiplied by the number of draws. Selection time
+//! is the rest of the time spent in the kernel.
+class Telemetry {
+public:
+  //! \brief Constructor, takes the file to write to and the minimum number of seconds between reports.
+  Telemetry(const string, double=10.);
+
+  //! \brief Set the total number of trials the job will run, used for the ETA.
+  void setTotalTrials(long t) { total_trials = t; }
+
+  //! \brief Add the counters of a block of trials. Thread safe.
+  void add(const TelemetryObserver&);
+
+  //! \brief Add time spent writing output. Thread safe.
+  void addIO(double);
+
+  //! \brief Write a report if enough time has passed since the last one. Thread safe.
+  void report();
+
+  //! \brief Write a report now. Thread safe.
+  void flush();
+
+private:
+  //! \brief Write a report, the lock must be held.
+  void write();
+
+  string fileName;
+  double interval;
+  std::mutex lock;
+
+  high_resolution_clock::time_point start, last_report;
+
+  //! \brief The measured cost of a single random draw, in seconds.
+  double draw_cost = 0.;
+
+  long total_trials = 0;
+  TelemetryObserver totals;
+  double io_time = 0.;
+  bool header = false;
+};
+
+#endif // __TELEMETRY_HPP__
@@ -13,6 +13,10 @@ using std::string;
 using std::stringstream;
 
 #include <random>
+#include <functional>
+#include <cmath>
+#include <limits>
+#include <algorithm>
 #include <chrono>
 using std::chrono::duration;
 using std::chrono::duration_cast;
@@ -26,6 +30,9 @@ using std::endl;
 using std::map;
 using std::pair;
 
+#include <thread>
+#include <atomic>
+
 
 template<typename T> inline string toString(T t) {
   stringstream stream;
@@ -35,7 +42,39 @@ template<typename T> inline string toString(T t) {
   return str;
 }
 
-inline bool writeToFile(const string fileName, const map<int,int>& data, double time, int trials, double alpha=-1, double beta=0, double gamma=0, double delta=0, double kp=0, double km=0) {
+//! \brief Derive the seed of an independent random substream from a base seed (splitmix64 finalizer).
+inline unsigned substreamSeed(unsigned seed, unsigned long stream) {
+  unsigned long long z = (static_cast<unsigned long long>(seed) << 32) ^ (stream + 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z = z ^ (z >> 31);
+  return static_cast<unsigned>(z ^ (z >> 32));
+}
+
+//! \brief The engine the trials draw from. Each block of trials reseeds it for its substream, and a block can take
+//! 10^8 or more draws, so the engine needs a period far beyond that of a 32 bit linear congruential generator.
+typedef std::mt19937_64 RandomEngine;
+
+//! \brief Call f(i) for every i in [0, n), spread over some number of threads (0 means one per core). Threads take
+//! the next i as they finish, so uneven work is balanced.
+template<typename F> inline void parallelFor(int n, int nthreads, F f) {
+  if (nthreads<1) nthreads = std::thread::hardware_concurrency();
+  nthreads = std::max(1, std::min(nthreads, n));
+  if (nthreads==1) {
+    for (int i=0; i<n; ++i) f(i);
+    return;
+  }
+  std::atomic<int> next(0);
+  vector<std::thread> threads;
+  for (int t=0; t<nthreads; ++t)
+    threads.push_back(std::thread([&]() {
+      for (int i=next++; i<n; i=next++) f(i);
+    }));
+  for (auto &thread : threads) thread.join();
+}
+
+//! \brief Write a distribution of the integrated current, either counts (int) or expected counts (double).
+template<typename T> inline bool writeToFile(const string fileName, const map<int,T>& data, double time, int trials, double alpha=-1, double beta=0, double gamma=0, double delta=0, double kp=0, double km=0) {
   std::ofstream fout(fileName);
   if (fout.fail()) {
     cout << "Error occurred in opening \"" + fileName + "\".\n";